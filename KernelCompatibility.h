@@ -0,0 +1,70 @@
+#ifndef KERNEL_COMPATIBILITY_H
+#define KERNEL_COMPATIBILITY_H
+
+/* Kernel Compatibility Definitions */
+//The driver is written against iTop-4412's Linux 3.0. These definitions let it build on newer kernels, e.g. an x86 PC running the simulated interrupt source.
+#include <linux/version.h>
+
+//ACCESS_ONCE() is removed since 4.15
+#ifndef ACCESS_ONCE
+#define ACCESS_ONCE(x) (*(volatile typeof(x) *)&(x))
+#endif
+
+//random32() is renamed to prandom_u32() since 3.8, then replaced by get_random_u32() since 6.1
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 1, 0)
+#define random32() get_random_u32()
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(3, 8, 0)
+#define random32() prandom_u32()
+#endif
+
+//class_create() no longer takes the owner module since 6.4
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+#define CreateDeviceClass(lpszName) class_create(lpszName)
+#else
+#define CreateDeviceClass(lpszName) class_create(THIS_MODULE, lpszName)
+#endif
+
+//hrtimer_init() is replaced by hrtimer_setup() since 6.15
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 15, 0)
+#define InitializeHrtimer(lpTimer, lpFunction) hrtimer_setup((lpTimer), (lpFunction), CLOCK_MONOTONIC, HRTIMER_MODE_REL)
+#else
+#define InitializeHrtimer(lpTimer, lpFunction) do { hrtimer_init((lpTimer), CLOCK_MONOTONIC, HRTIMER_MODE_REL); (lpTimer)->function = (lpFunction); } while (0)
+#endif
+
+//irq_set_affinity() is exported to modules since 5.12. Before, modules can only set the affinity hint, which 3.0 leaves to irqbalance or /proc/irq/<n>/smp_affinity to apply
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 12, 0)
+#define SetIrqAffinity(iIrq, lpMask) irq_set_affinity((iIrq), (lpMask))
+#define ClearIrqAffinity(iIrq) do { } while (0)
+#else
+#define SetIrqAffinity(iIrq, lpMask) irq_set_affinity_hint((iIrq), (lpMask))
+#define ClearIrqAffinity(iIrq) irq_set_affinity_hint((iIrq), NULL) //free_irq() expects no hint
+#endif
+
+//struct splice_pipe_desc has nr_pages_max since 3.5
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 5, 0)
+#define SPLICE_PIPE_DESC_MAX_PAGES(iCount) .nr_pages_max = (iCount),
+#else
+#define SPLICE_PIPE_DESC_MAX_PAGES(iCount)
+#endif
+
+//Free buffers of a pipe, read without the pipe lock so it's a hint only. struct pipe_inode_info is a head/tail ring since 5.5, with max_usage since 5.8
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 8, 0)
+#define GetPipeFreeBuffers(lpPipe) ((lpPipe)->max_usage - pipe_occupancy(READ_ONCE((lpPipe)->head), READ_ONCE((lpPipe)->tail)))
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5, 5, 0)
+#define GetPipeFreeBuffers(lpPipe) ((lpPipe)->ring_size - pipe_occupancy(READ_ONCE((lpPipe)->head), READ_ONCE((lpPipe)->tail)))
+#else
+#define GetPipeFreeBuffers(lpPipe) ((lpPipe)->buffers - ACCESS_ONCE((lpPipe)->nrbufs))
+#endif
+
+//Pipe buffers of private pages. map() and unmap() are removed since 3.15, can_merge since 5.1, confirm() and steal() are optional since 5.8
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 8, 0)
+#define DEFINE_PRIVATE_PIPE_BUF_OPERATIONS(lpName) static const struct pipe_buf_operations lpName = {.release = generic_pipe_buf_release, .get = generic_pipe_buf_get}
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5, 1, 0)
+#define DEFINE_PRIVATE_PIPE_BUF_OPERATIONS(lpName) static const struct pipe_buf_operations lpName = {.confirm = generic_pipe_buf_confirm, .release = generic_pipe_buf_release, .steal = generic_pipe_buf_steal, .get = generic_pipe_buf_get}
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(3, 15, 0)
+#define DEFINE_PRIVATE_PIPE_BUF_OPERATIONS(lpName) static const struct pipe_buf_operations lpName = {.can_merge = 0, .confirm = generic_pipe_buf_confirm, .release = generic_pipe_buf_release, .steal = generic_pipe_buf_steal, .get = generic_pipe_buf_get}
+#else
+#define DEFINE_PRIVATE_PIPE_BUF_OPERATIONS(lpName) static const struct pipe_buf_operations lpName = {.can_merge = 0, .map = generic_pipe_buf_map, .unmap = generic_pipe_buf_unmap, .confirm = generic_pipe_buf_confirm, .release = generic_pipe_buf_release, .steal = generic_pipe_buf_steal, .get = generic_pipe_buf_get}
+#endif
+
+#endif
@@ -10,4 +10,17 @@ static inline long GetMin(long iNum1, long iNum2) { return iNum1 < iNum2 ? iNum1
 static inline long GetMax(long iNum1, long iNum2) { return iNum1 > iNum2 ? iNum1 : iNum2; }
 static inline long GetAbs(long iNum) { return iNum >= 0 ? iNum : -iNum; }
 
+//Division by an invariant divisor without a divide instruction (Cortex-A9 has none): iQuotient = DivideByReciprocal(iDividend, GetReciprocal(iDivisor))
+//iDivisor must be at least 2. The result is exact as long as iDividend * iDivisor < 2^32
+static inline unsigned int GetReciprocal(unsigned int iDivisor) { return 0xFFFFFFFFU / iDivisor + 1; }
+static inline unsigned int DivideByReciprocal(unsigned int iDividend, unsigned int iReciprocal) { return (unsigned int)(((unsigned long long)iDividend * iReciprocal) >> 32); }
+
+//xorshift32 pseudo-random number generator, iState must not be 0. Returns the next state, which is also the random number
+static inline unsigned int GetNextXorshift32(unsigned int iState) {
+    iState ^= iState << 13;
+    iState ^= iState >> 17;
+    iState ^= iState << 5;
+    return iState;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,73 @@
+/* SampleFormats.h
+ *
+ * This header file contains encoders and decoders of compact sample formats (see CTL_CMD_SET_SAMPLE_FORMAT).
+ * It's shared by the driver and user applications, so it depends on nothing but C.
+ */
+
+#ifndef SAMPLE_FORMATS_H
+#define SAMPLE_FORMATS_H
+
+//16-bit format: samples are packed as unsigned short in the byte order of the platform, larger samples saturate to 0xFFFF
+static inline unsigned int EncodeSamples16(unsigned short * lpOutput, const unsigned int * lpInput, unsigned int iCount) {
+    unsigned int i;
+    for (i = 0; i < iCount; ++i) {
+        lpOutput[i] = lpInput[i] > 0xFFFF ? 0xFFFF : lpInput[i];
+    }
+    return iCount * sizeof(unsigned short);
+}
+
+static inline unsigned int DecodeSamples16(unsigned int * lpOutput, const unsigned short * lpInput, unsigned int iCount) {
+    unsigned int i;
+    for (i = 0; i < iCount; ++i) {
+        lpOutput[i] = lpInput[i];
+    }
+    return iCount;
+}
+
+//Delta/varint format: each sample is stored as its difference from the previous sample (the first one from 0), zigzag-mapped so small negative differences stay small,
+//then written 7 bits per Byte, least significant group first, with bit 7 set on every Byte but the last. Flat runs of the waveform take 1 Byte per sample.
+//Returns the number of Bytes written, or 0 if the output doesn't fit in iCapacity Bytes
+static inline unsigned int EncodeSamplesDeltaVarint(unsigned char * lpOutput, unsigned int iCapacity, const unsigned int * lpInput, unsigned int iCount) {
+    unsigned int i, iSize = 0, iPrevious = 0;
+    for (i = 0; i < iCount; ++i) {
+        int iDelta = (int)(lpInput[i] - iPrevious);
+        unsigned int iZigzag = ((unsigned int)iDelta << 1) ^ (unsigned int)(iDelta >> 31);
+        iPrevious = lpInput[i];
+        while (iZigzag >= 0x80) {
+            if (iSize >= iCapacity) {
+                return 0;
+            }
+            lpOutput[iSize++] = (unsigned char)(iZigzag | 0x80);
+            iZigzag >>= 7;
+        }
+        if (iSize >= iCapacity) {
+            return 0;
+        }
+        lpOutput[iSize++] = (unsigned char)iZigzag;
+    }
+    return iSize;
+}
+
+//Returns the number of samples decoded, less than iCount if the input is truncated
+static inline unsigned int DecodeSamplesDeltaVarint(unsigned int * lpOutput, unsigned int iCount, const unsigned char * lpInput, unsigned int iSize) {
+    unsigned int i, iOffset = 0, iPrevious = 0;
+    for (i = 0; i < iCount; ++i) {
+        unsigned int iZigzag = 0, iShift = 0;
+        for (;;) {
+            if (iOffset >= iSize || iShift > 28) {
+                return i;
+            }
+            unsigned char iByte = lpInput[iOffset++];
+            iZigzag |= (unsigned int)(iByte & 0x7F) << iShift;
+            if (!(iByte & 0x80)) {
+                break;
+            }
+            iShift += 7;
+        }
+        iPrevious += (iZigzag >> 1) ^ -(iZigzag & 1);
+        lpOutput[i] = iPrevious;
+    }
+    return i;
+}
+
+#endif
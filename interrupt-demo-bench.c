@@ -0,0 +1,464 @@
+/* Interrupt Demo Benchmark
+ *
+ * This is a user application, which measures the read paths of Interrupt Demo Driver end to end.
+ *
+ * For each access mode, it consumes frames from the device file for a while and prints one line of JSON:
+ * || Key                      || Meaning                                                                  ||
+ * || mode                     || Access mode, see arrBenchModes                                           ||
+ * || frames, bytes            || Frames and Bytes received                                                ||
+ * || frames_per_s, bytes_per_s|| Throughput                                                               ||
+ * || dropped                  || Frames lost before reaching this application, from sequence number gaps  ||
+ * || corrupted                || Frames in a compact sample format which failed to decode                 ||
+ * || latency_ns               || Percentiles of the time from S_INT to the frame being available here     ||
+ * || cpu_user_s, cpu_sys_s    || CPU time used by this application                                        ||
+ * || context_switches         || Voluntary and involuntary context switches of this application           ||
+ * The splice mode moves frame records to /dev/null without looking at them, like a recorder would, so it only reports bytes and CPU time.
+ * Lines are self-contained, so results of different driver versions can be appended to one file and compared.
+ *
+ * Without the S_INT hardware, load the driver with simulated interrupts (see interrupt-demo.h), or use -s to trigger S_INT by software.
+ *
+ * Build: make bench (set CROSS_COMPILE for the board)
+ * Usage: interrupt-demo-bench [-d Device] [-m Mode] [-t Seconds] [-s FramesPerTrigger] [-f SampleFormat] [-w WakeupFrames] [-u WakeupMicroseconds] [-a]
+ * Frames in compact sample formats (-f, one of CTL_ARG_SAMPLE_FORMAT_*) are decoded, so the decoding cost shows up in the CPU time.
+ * -w, -u and -a set the wakeup policy of the device file (CTL_CMD_SET_WAKEUP_THRESHOLD, CTL_CMD_SET_WAKEUP_TIMEOUT and CTL_ARG_WAKEUP_ALIGN_DP_INT), compare context_switches to tune it.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "interrupt-demo.h"
+#include "SampleFormats.h"
+
+#define BENCH_DEFAULT_DEVICE   "/dev/" NODE_NAME
+#define BENCH_DEFAULT_SECONDS  5
+#define BENCH_MAX_LATENCIES    (1 << 20) //Latency samples kept per mode, later frames are counted but not sampled
+#define BENCH_POLL_TIMEOUT_MS  1000
+#define BENCH_BATCH_FRAMES     64 //Frame records per read() in batch-read mode
+#define BENCH_SPLICE_SIZE      (16 * 4096) //Bytes per splice() in splice mode, within the default pipe capacity
+
+//Results of a mode
+struct bench_result {
+    unsigned long long lFrames;
+    unsigned long long lBytes;
+    unsigned long long lDropped;
+    unsigned long long lCorrupted; //Frames which failed to decode
+    unsigned long long lSampleSum; //Sum of all samples, so decoding is never optimized out
+    unsigned int iLastSequence;
+    int bHasSequence;
+    unsigned long long * lpLatencies; //In nanoseconds
+    size_t iLatencyCount;
+};
+
+//Access modes
+struct bench_mode {
+    const char * lpszName;
+    int (*lpRun)(int iDevice, struct bench_result * lpResult, double dSeconds);
+    int iOpenFlags; //Extra flags of open()
+};
+
+static volatile int bStopTrigger = 0;
+static unsigned int iTriggerCount = 0; //-s, frames triggered by software per ioctl(), 0 means the driver is driven by interrupts
+static int iSampleFormat = -1; //-f, sample format set before running, -1 keeps the current one
+static unsigned int iWakeupThreshold = 1; //-w, frames which wake this application up
+static unsigned int iWakeupTimeout = 0; //-u, microseconds the oldest frame may wait, 0 for no timeout
+static unsigned int iWakeupAlign = CTL_ARG_WAKEUP_ALIGN_NONE; //-a, wake up at DP_INT ticks only
+
+/* Helper Functions */
+static unsigned long long GetMonotonicTime(void) {
+    struct timespec tsNow;
+    clock_gettime(CLOCK_MONOTONIC, &tsNow); //Same clock as the S_INT timestamp of frames (ktime_get())
+    return (unsigned long long)tsNow.tv_sec * 1000000000ULL + tsNow.tv_nsec;
+}
+
+static double GetCpuTime(const struct timeval * lpTime) {
+    return lpTime->tv_sec + lpTime->tv_usec / 1e6;
+}
+
+static int CompareLatencies(const void * lpLeft, const void * lpRight) {
+    unsigned long long lLeft = *(const unsigned long long *)lpLeft, lRight = *(const unsigned long long *)lpRight;
+    return lLeft < lRight ? -1 : lLeft > lRight;
+}
+
+static unsigned long long GetPercentile(const struct bench_result * lpResult, unsigned int iPercent) {
+    if (0 == lpResult->iLatencyCount) {
+        return 0;
+    }
+    return lpResult->lpLatencies[(lpResult->iLatencyCount - 1) * iPercent / 100];
+}
+
+/*
+ * AccountFrame() Function
+ *
+ * This function decodes a received frame and records its size, the sequence gap since the previous frame, and its latency.
+ *
+ */
+static void AccountFrame(struct bench_result * lpResult, const unsigned int * lpFrame, unsigned long long lNow) {
+    unsigned int iSequence = lpFrame[DATA_EXTRA_SEQUENCE];
+    unsigned long long lTimestamp = lpFrame[DATA_EXTRA_TIMESTAMP_LOW] | ((unsigned long long)lpFrame[DATA_EXTRA_TIMESTAMP_HIGH] << 32);
+    unsigned int arrSamples[DATA_BUFFER_WAVE_DATA_SIZE];
+    const unsigned int * lpSamples = arrSamples;
+    unsigned int i, iSampleCount = lpFrame[DATA_EXTRA_SAMPLE_COUNT] < DATA_BUFFER_WAVE_DATA_SIZE ? lpFrame[DATA_EXTRA_SAMPLE_COUNT] : DATA_BUFFER_WAVE_DATA_SIZE;
+    switch (lpFrame[DATA_EXTRA_SAMPLE_FORMAT]) {
+    case CTL_ARG_SAMPLE_FORMAT_U16:
+        DecodeSamples16(arrSamples, (const unsigned short *)lpFrame, iSampleCount);
+        break;
+    case CTL_ARG_SAMPLE_FORMAT_DELTA_VARINT:
+        if (DecodeSamplesDeltaVarint(arrSamples, iSampleCount, (const unsigned char *)lpFrame, lpFrame[DATA_EXTRA_WAVE_DATA_SIZE]) != iSampleCount) {
+            ++lpResult->lCorrupted;
+        }
+        break;
+    default:
+        lpSamples = lpFrame;
+        break;
+    }
+    for (i = 0; i < iSampleCount; ++i) {
+        lpResult->lSampleSum += lpSamples[i];
+    }
+    ++lpResult->lFrames;
+    lpResult->lBytes += lpFrame[DATA_EXTRA_WAVE_DATA_SIZE] + DATA_BUFFER_EXTRA_DATA_SIZE * sizeof(unsigned int);
+    if (lpResult->bHasSequence && iSequence - lpResult->iLastSequence > 1) {
+        lpResult->lDropped += iSequence - lpResult->iLastSequence - 1;
+    }
+    lpResult->iLastSequence = iSequence;
+    lpResult->bHasSequence = 1;
+    if (lpResult->iLatencyCount < BENCH_MAX_LATENCIES && lNow > lTimestamp) {
+        lpResult->lpLatencies[lpResult->iLatencyCount++] = lNow - lTimestamp;
+    }
+}
+
+//Waits until the device is readable, returns 0 on timeout
+static int WaitReadable(int iDevice) {
+    struct pollfd pfdDevice = {iDevice, POLLIN, 0};
+    return poll(&pfdDevice, 1, BENCH_POLL_TIMEOUT_MS);
+}
+
+/* Access Modes */
+//Blocking read(), one frame per call
+static int RunBlockingRead(int iDevice, struct bench_result * lpResult, double dSeconds) {
+    unsigned int arrFrame[DATA_BUFFER_SIZE];
+    unsigned long long lEnd = GetMonotonicTime() + (unsigned long long)(dSeconds * 1e9);
+    while (GetMonotonicTime() < lEnd) {
+        ssize_t iResult = read(iDevice, arrFrame, sizeof(arrFrame));
+        if (iResult < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return -errno;
+        }
+        AccountFrame(lpResult, arrFrame, GetMonotonicTime());
+    }
+    return 0;
+}
+
+//poll(), then non-blocking read() until -EAGAIN
+static int RunPollRead(int iDevice, struct bench_result * lpResult, double dSeconds) {
+    unsigned int arrFrame[DATA_BUFFER_SIZE];
+    unsigned long long lEnd = GetMonotonicTime() + (unsigned long long)(dSeconds * 1e9);
+    while (GetMonotonicTime() < lEnd) {
+        if (WaitReadable(iDevice) < 0 && EINTR != errno) {
+            return -errno;
+        }
+        while (read(iDevice, arrFrame, sizeof(arrFrame)) >= 0) {
+            AccountFrame(lpResult, arrFrame, GetMonotonicTime());
+        }
+        if (EAGAIN != errno && EINTR != errno) {
+            return -errno;
+        }
+    }
+    return 0;
+}
+
+//Blocking read() in CTL_ARG_READ_MODE_BATCH, as many frame records per call as fit in a buffer of BENCH_BATCH_FRAMES records
+static int RunBatchRead(int iDevice, struct bench_result * lpResult, double dSeconds) {
+    unsigned int iReadMode = CTL_ARG_READ_MODE_BATCH;
+    if (ioctl(iDevice, CTL_IOC(CTL_CMD_SET_READ_MODE), &iReadMode) < 0) {
+        return -errno;
+    }
+    static unsigned long long arrBuffer[BENCH_BATCH_FRAMES * FRAME_RECORD_MAX_SIZE / sizeof(unsigned long long)]; //Records are 8-Byte aligned
+    unsigned int arrFrame[DATA_BUFFER_SIZE];
+    unsigned long long lEnd = GetMonotonicTime() + (unsigned long long)(dSeconds * 1e9);
+    int iResult = 0;
+    while (GetMonotonicTime() < lEnd) {
+        ssize_t iSize = read(iDevice, arrBuffer, sizeof(arrBuffer));
+        if (iSize < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            iResult = -errno;
+            break;
+        }
+        unsigned long long lNow = GetMonotonicTime();
+        ssize_t iOffset = 0;
+        while (iOffset + (ssize_t)sizeof(struct interrupt_demo_frame_header) <= iSize) {
+            const struct interrupt_demo_frame_header * lpHeader = (const struct interrupt_demo_frame_header *)((const char *)arrBuffer + iOffset);
+            if (lpHeader->iRecordSize < sizeof(struct interrupt_demo_frame_header) || lpHeader->iDataSize > DATA_BUFFER_WAVE_DATA_SIZE * sizeof(unsigned int)) {
+                ++lpResult->lCorrupted;
+                break;
+            }
+            //Rebuild the Extra Data zone so AccountFrame() works on both layouts
+            memcpy(arrFrame, lpHeader + 1, lpHeader->iDataSize);
+            arrFrame[DATA_EXTRA_SEQUENCE] = lpHeader->iSequence;
+            arrFrame[DATA_EXTRA_TIMESTAMP_LOW] = (unsigned int)lpHeader->lTimestamp;
+            arrFrame[DATA_EXTRA_TIMESTAMP_HIGH] = (unsigned int)(lpHeader->lTimestamp >> 32);
+            arrFrame[DATA_EXTRA_SAMPLE_COUNT] = lpHeader->iSampleCount;
+            arrFrame[DATA_EXTRA_SAMPLE_FORMAT] = lpHeader->iSampleFormat;
+            arrFrame[DATA_EXTRA_PULSE_COUNT] = lpHeader->iPulseCount;
+            arrFrame[DATA_EXTRA_WAVE_DATA_SIZE] = lpHeader->iDataSize;
+            AccountFrame(lpResult, arrFrame, lNow);
+            lpResult->lBytes += sizeof(struct interrupt_demo_frame_header) - DATA_BUFFER_EXTRA_DATA_SIZE * sizeof(unsigned int); //Count the header instead of Extra Data zone
+            iOffset += lpHeader->iRecordSize;
+        }
+    }
+    iReadMode = CTL_ARG_READ_MODE_SINGLE_FRAME;
+    ioctl(iDevice, CTL_IOC(CTL_CMD_SET_READ_MODE), &iReadMode);
+    return iResult;
+}
+
+//poll(), then consume frames in place from the mapped Frame Ring of channel 0, following the protocol in interrupt-demo.h
+static int RunMmap(int iDevice, struct bench_result * lpResult, double dSeconds) {
+    long lPageSize = sysconf(_SC_PAGESIZE);
+    struct interrupt_demo_ring_control * lpControl = mmap(NULL, lPageSize, PROT_READ, MAP_SHARED, iDevice, 0);
+    if (MAP_FAILED == lpControl) {
+        return -errno;
+    }
+    size_t iMapSize = lpControl->iMapSize;
+    munmap(lpControl, lPageSize);
+    unsigned char * lpMap = mmap(NULL, iMapSize, PROT_READ | PROT_WRITE, MAP_SHARED, iDevice, 0);
+    if (MAP_FAILED == lpMap) {
+        return -errno;
+    }
+    lpControl = (struct interrupt_demo_ring_control *)lpMap;
+    unsigned int iTail = __atomic_load_n(&lpControl->iTail, __ATOMIC_ACQUIRE);
+    while (!__atomic_compare_exchange_n(&lpControl->iTail, &iTail, __atomic_load_n(&lpControl->iHead, __ATOMIC_ACQUIRE), 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) { //Skip old frames, retry if the driver reclaims one meanwhile
+    }
+    unsigned int arrFrame[DATA_BUFFER_SIZE];
+    unsigned long long lEnd = GetMonotonicTime() + (unsigned long long)(dSeconds * 1e9);
+    int iResult = 0;
+    while (GetMonotonicTime() < lEnd) {
+        unsigned int iTail = __atomic_load_n(&lpControl->iTail, __ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&lpControl->iHead, __ATOMIC_ACQUIRE) == iTail) {
+            if (WaitReadable(iDevice) < 0 && EINTR != errno) {
+                iResult = -errno;
+                break;
+            }
+            continue;
+        }
+        const unsigned int * lpFrame = (const unsigned int *)(lpMap + lpControl->iFrameOffset + (iTail & (lpControl->iDepth - 1)) * lpControl->iFrameSize);
+        unsigned int iWriteSequence = __atomic_load_n(&lpFrame[DATA_EXTRA_WRITE_SEQUENCE], __ATOMIC_ACQUIRE);
+        if (iWriteSequence & 1) { //Being overwritten
+            continue;
+        }
+        memcpy(arrFrame, lpFrame, sizeof(arrFrame)); //A real consumer would process the frame here instead
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&lpFrame[DATA_EXTRA_WRITE_SEQUENCE], __ATOMIC_RELAXED) != iWriteSequence) { //Torn
+            continue;
+        }
+        __atomic_compare_exchange_n(&lpControl->iTail, &iTail, iTail + 1, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+        AccountFrame(lpResult, arrFrame, GetMonotonicTime());
+    }
+    munmap(lpMap, iMapSize);
+    return iResult;
+}
+
+//Blocking splice() of frame records into a pipe, then from the pipe to /dev/null, samples never reach this application
+static int RunSplice(int iDevice, struct bench_result * lpResult, double dSeconds) {
+    int arrPipe[2];
+    if (pipe(arrPipe) < 0) {
+        return -errno;
+    }
+    int iNull = open("/dev/null", O_WRONLY);
+    if (iNull < 0) {
+        int iError = -errno;
+        close(arrPipe[0]);
+        close(arrPipe[1]);
+        return iError;
+    }
+    unsigned long long lEnd = GetMonotonicTime() + (unsigned long long)(dSeconds * 1e9);
+    int iResult = 0;
+    while (GetMonotonicTime() < lEnd) {
+        ssize_t iSize = splice(iDevice, NULL, arrPipe[1], NULL, BENCH_SPLICE_SIZE, SPLICE_F_MOVE);
+        if (iSize < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            iResult = -errno;
+            break;
+        }
+        lpResult->lBytes += iSize;
+        while (iSize > 0) { //Drain the pipe, so the next splice() never loses records
+            ssize_t iMoved = splice(arrPipe[0], NULL, iNull, NULL, iSize, SPLICE_F_MOVE);
+            if (iMoved <= 0) {
+                iResult = iMoved < 0 ? -errno : -EIO;
+                break;
+            }
+            iSize -= iMoved;
+        }
+        if (iResult < 0) {
+            break;
+        }
+    }
+    close(iNull);
+    close(arrPipe[0]);
+    close(arrPipe[1]);
+    return iResult;
+}
+
+static const struct bench_mode arrBenchModes[] = {
+    {"read", RunBlockingRead, 0},
+    {"poll-read", RunPollRead, O_NONBLOCK},
+    {"batch-read", RunBatchRead, 0},
+    {"mmap", RunMmap, 0},
+    {"splice", RunSplice, 0},
+};
+#define BENCH_MODE_COUNT (sizeof(arrBenchModes) / sizeof(arrBenchModes[0]))
+
+/* Load Generation */
+//Triggers S_INT by software until bStopTrigger is set, used when there is no interrupt source
+static void * TriggerThread(void * lpData) {
+    int iDevice = *(int *)lpData;
+    unsigned int iCount = iTriggerCount;
+    while (!bStopTrigger) {
+        if (ioctl(iDevice, CTL_IOC(CTL_CMD_TRIGGER_S_INT), &iCount) < 0) {
+            perror("ioctl(CTL_CMD_TRIGGER_S_INT)");
+            break;
+        }
+        usleep(1000);
+    }
+    return NULL;
+}
+
+/*
+ * RunBenchMode() Function
+ *
+ * This function runs an access mode on a freshly opened device file and prints its results as one line of JSON.
+ *
+ */
+static int RunBenchMode(const char * lpszDevice, const struct bench_mode * lpMode, double dSeconds) {
+    int iDevice = open(lpszDevice, O_RDWR | lpMode->iOpenFlags);
+    if (iDevice < 0) {
+        fprintf(stderr, "Failed to open %s: %s\n", lpszDevice, strerror(errno));
+        return -errno;
+    }
+    struct bench_result resResult;
+    memset(&resResult, 0, sizeof(resResult));
+    resResult.lpLatencies = malloc(BENCH_MAX_LATENCIES * sizeof(unsigned long long));
+    if (!resResult.lpLatencies) {
+        close(iDevice);
+        return -ENOMEM;
+    }
+    //Start from an empty Frame Ring, so old frames don't count as latency. RunMmap() drains it through the mapping, a read() would make this file a read() consumer whose readiness never follows iTail
+    if (RunMmap != lpMode->lpRun) {
+        unsigned int arrFrame[DATA_BUFFER_SIZE];
+        fcntl(iDevice, F_SETFL, fcntl(iDevice, F_GETFL) | O_NONBLOCK);
+        while (read(iDevice, arrFrame, sizeof(arrFrame)) >= 0) {
+        }
+        fcntl(iDevice, F_SETFL, (fcntl(iDevice, F_GETFL) & ~O_NONBLOCK) | lpMode->iOpenFlags);
+    }
+    if (iSampleFormat >= 0) {
+        unsigned int iFormat = iSampleFormat;
+        if (ioctl(iDevice, CTL_IOC(CTL_CMD_SET_SAMPLE_FORMAT), &iFormat) < 0) {
+            fprintf(stderr, "Failed to set sample format %d: %s\n", iSampleFormat, strerror(errno));
+        }
+    }
+    if (ioctl(iDevice, CTL_IOC(CTL_CMD_SET_WAKEUP_THRESHOLD), &iWakeupThreshold) < 0 || ioctl(iDevice, CTL_IOC(CTL_CMD_SET_WAKEUP_TIMEOUT), &iWakeupTimeout) < 0 || ioctl(iDevice, CTL_IOC(CTL_CMD_SET_WAKEUP_ALIGN), &iWakeupAlign) < 0) {
+        fprintf(stderr, "Failed to set wakeup policy: %s\n", strerror(errno));
+    }
+    pthread_t thdTrigger;
+    if (iTriggerCount) {
+        bStopTrigger = 0;
+        pthread_create(&thdTrigger, NULL, TriggerThread, &iDevice);
+    }
+    struct rusage rsgBegin, rsgEnd;
+    getrusage(RUSAGE_SELF, &rsgBegin);
+    unsigned long long lBegin = GetMonotonicTime();
+    int iResult = lpMode->lpRun(iDevice, &resResult, dSeconds);
+    double dElapsed = (GetMonotonicTime() - lBegin) / 1e9;
+    getrusage(RUSAGE_SELF, &rsgEnd);
+    if (iTriggerCount) {
+        bStopTrigger = 1;
+        pthread_join(thdTrigger, NULL);
+    }
+    close(iDevice);
+    if (iResult < 0) {
+        fprintf(stderr, "Mode %s failed: %s\n", lpMode->lpszName, strerror(-iResult));
+    }
+    qsort(resResult.lpLatencies, resResult.iLatencyCount, sizeof(unsigned long long), CompareLatencies);
+    printf("{\"mode\": \"%s\", \"error\": %d, \"seconds\": %.3f, \"frames\": %llu, \"bytes\": %llu, \"frames_per_s\": %.1f, \"bytes_per_s\": %.1f, \"dropped\": %llu, \"corrupted\": %llu, "
+           "\"latency_ns\": {\"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"max\": %llu}, \"cpu_user_s\": %.3f, \"cpu_sys_s\": %.3f, \"context_switches\": %ld}\n",
+           lpMode->lpszName, iResult, dElapsed, resResult.lFrames, resResult.lBytes, resResult.lFrames / dElapsed, resResult.lBytes / dElapsed, resResult.lDropped, resResult.lCorrupted,
+           GetPercentile(&resResult, 50), GetPercentile(&resResult, 90), GetPercentile(&resResult, 99), GetPercentile(&resResult, 100),
+           GetCpuTime(&rsgEnd.ru_utime) - GetCpuTime(&rsgBegin.ru_utime), GetCpuTime(&rsgEnd.ru_stime) - GetCpuTime(&rsgBegin.ru_stime), (rsgEnd.ru_nvcsw + rsgEnd.ru_nivcsw) - (rsgBegin.ru_nvcsw + rsgBegin.ru_nivcsw));
+    fflush(stdout);
+    free(resResult.lpLatencies);
+    return iResult;
+}
+
+int main(int argc, char * argv[]) {
+    const char * lpszDevice = BENCH_DEFAULT_DEVICE;
+    const char * lpszMode = NULL; //NULL runs all modes
+    double dSeconds = BENCH_DEFAULT_SECONDS;
+    int iOption;
+    while ((iOption = getopt(argc, argv, "d:m:t:s:f:w:u:ah")) != -1) {
+        switch (iOption) {
+        case 'd':
+            lpszDevice = optarg;
+            break;
+        case 'm':
+            lpszMode = optarg;
+            break;
+        case 't':
+            dSeconds = atof(optarg);
+            break;
+        case 's':
+            iTriggerCount = strtoul(optarg, NULL, 0);
+            break;
+        case 'f':
+            iSampleFormat = atoi(optarg);
+            break;
+        case 'w':
+            iWakeupThreshold = strtoul(optarg, NULL, 0);
+            break;
+        case 'u':
+            iWakeupTimeout = strtoul(optarg, NULL, 0);
+            break;
+        case 'a':
+            iWakeupAlign = CTL_ARG_WAKEUP_ALIGN_DP_INT;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-d Device] [-m Mode] [-t Seconds] [-s FramesPerTrigger] [-f SampleFormat] [-w WakeupFrames] [-u WakeupMicroseconds] [-a]\nModes:", argv[0]);
+            for (size_t i = 0; i < BENCH_MODE_COUNT; ++i) {
+                fprintf(stderr, " %s", arrBenchModes[i].lpszName);
+            }
+            fprintf(stderr, "\n");
+            return 'h' == iOption ? 0 : 1;
+        }
+    }
+    int iFailures = 0, bFound = 0;
+    for (size_t i = 0; i < BENCH_MODE_COUNT; ++i) {
+        if (lpszMode && strcmp(lpszMode, arrBenchModes[i].lpszName)) {
+            continue;
+        }
+        bFound = 1;
+        if (RunBenchMode(lpszDevice, &arrBenchModes[i], dSeconds) < 0) {
+            ++iFailures;
+        }
+    }
+    if (!bFound) {
+        fprintf(stderr, "Unknown mode %s.\n", lpszMode);
+        return 1;
+    }
+    return iFailures ? 1 : 0;
+}
@@ -32,57 +32,1608 @@
 #include <linux/platform_device.h>
 #include <linux/regulator/consumer.h>
 #include <linux/uaccess.h>
+#ifdef CONFIG_ARCH_EXYNOS4
 #include <mach/gpio.h>
 #include <mach/regs-gpio.h>
 #include <plat/gpio-cfg.h>
+#endif
 /* Interrupt-related header files */
 #include <linux/interrupt.h>
 #include <linux/irq.h>
 /* Spin-Lock, for we need it in Interrupt Handlers, we can't use Mutex */
 #include <linux/spinlock.h>
+/* Mutex, used where sleeping is allowed (e.g. around copy_to_user()) */
+#include <linux/mutex.h>
+/* Wait Queue and poll() support, used to wait for new frames */
+#include <linux/poll.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+/* Timestamps and bottom halves of S_INT */
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/workqueue.h>
+/* Memory allocation and mapping of Frame Ring */
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/splice.h>
 /* Library to generate random numbers */
 #include <linux/random.h>
+//For memdup_user() and kmemdup()
+#include <linux/string.h>
+#include <linux/slab.h>
+//For statistics
+#include <linux/percpu.h>
+#include <linux/bitops.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+//For simulated interrupt source
+#include <linux/hrtimer.h>
+#include <linux/kthread.h>
+#include <linux/rcupdate.h>
 /* Local header files */
+#include "KernelCompatibility.h"
 #include "MathFunctions.h"
+#include "SampleFormats.h"
 #include "interrupt-demo.h"
 
 //Device Data
 static struct class * clsDevice; //Device node
 static int iMajorDeviceNumber = 0; //Set to 0 to allocate device number automatically
 static struct cdev cdevDevice; //cdev structure
+static struct cdev cdevEventsDevice; //cdev structure of IRQ Event FIFO
+static struct cdev cdevPlaybackDevice; //cdev structure of Playback Ring
 
 //Spin-Locks
-#define IS_DATA_BUFFER_SPINLOCK_REQUESTED //Switch of arrDataBuffer Spin-Lock
+//Locks and wait queues are taken on different CPUs (S_INT CPU, reader CPUs), each one has its own cache line
+#define IS_DATA_BUFFER_SPINLOCK_REQUESTED //Switch of Frame Ring producer Spin-Lock
 #ifdef IS_DATA_BUFFER_SPINLOCK_REQUESTED
-static rwlock_t rwlkDataBufferLock; //Spin-Lock to protect arrDataBuffer, use Read-Write-Lock to improve concurrency performance
+static spinlock_t spnlkDataBufferLock __cacheline_aligned_in_smp; //Spin-Lock to serialize producers of Frame Ring (S_INT bottom half and software-triggered S_INT). Consumers never take it, so they never block the producer
 #endif
-#define IS_IOCTL_OPERATION_SPINLOCK_REQUESTED //Switch of IoCtl operations Spin-Lock
-#ifdef IS_IOCTL_OPERATION_SPINLOCK_REQUESTED
-static spinlock_t spnlkIoCtlLock; //Spin-Lock to protect IoCtl operations
+static spinlock_t spnlkSIntEventLock __cacheline_aligned_in_smp; //Spin-Lock to serialize producers of S_INT Event Queue (S_INT top half and software-triggered S_INT)
+
+//Mutexes
+#define IS_IOCTL_OPERATION_MUTEX_REQUESTED //Switch of IoCtl operations Mutex
+#ifdef IS_IOCTL_OPERATION_MUTEX_REQUESTED
+static struct mutex mtxIoCtlLock __cacheline_aligned_in_smp; //Mutex to serialize IoCtl operations, disable_irq() may sleep so we can't use Spin-Lock here. The S_INT bottom half never takes it, it reads published settings instead
 #endif
+static struct mutex mtxDataRingReadLock __cacheline_aligned_in_smp; //Mutex to serialize consumers of Frame Rings, copy_to_user() may sleep so we can't use Spin-Lock here
+static struct mutex mtxIrqEventReadLock; //Mutex to serialize consumers of IRQ Event FIFO
+static struct mutex mtxPlaybackWriteLock; //Mutex to serialize write() into Playback Ring, copy_from_user() may sleep
+
+//Wait Queues
+static wait_queue_head_t wqDataRingReadQueue __cacheline_aligned_in_smp; //Consumers sleep here until the S_INT bottom half publishes new frames
+static wait_queue_head_t wqIrqEventReadQueue; //Consumers of IRQ Event FIFO sleep here until a record is queued
+static wait_queue_head_t wqPlaybackWriteQueue; //Producers of Playback Ring sleep here until DAC_INT drains it to the low watermark
+
+//Frame Ring
+//Single-producer ring of frames. iHead and iTail are free-running counters, frame index is (counter & (iDepth - 1)).
+//The producer only writes iHead, consumers advance iTail (read() consumers to the fastest open file's cursor, see UpdateDataRingTail()). When the ring is full, the producer drops the newest frame or reclaims the oldest one (by advancing iTail with cmpxchg()), so a slow consumer never stalls the producer.
+//Each frame slot carries a seqcount (DATA_EXTRA_WRITE_SEQUENCE), so a consumer detects a frame reclaimed while it was copying it, and never has to mask S_INT.
+//iHead and iTail live in the Control Page, which is mapped to user space together with the frames (see header file), so a consumer may also be a user space process.
+//Fields read by consumers are never written after initialization, fields written by the producer start a cache line of their own.
+struct interrupt_demo_ring {
+    //Read mostly
+    unsigned int iDepth; //Number of frames, must be a power of 2
+    unsigned int iDepthShift; //log2(iDepth)
+    unsigned long lMapSize; //Size of lpControl area, including Control Page and frames
+    struct interrupt_demo_ring_control * lpControl; //Control Page, beginning of the vmalloc_user() area
+    unsigned int (*lpFrames)[DATA_BUFFER_SIZE]; //Frame storage, iDepth frames following Control Page
+    unsigned int (*lpTriggerHistory)[DATA_BUFFER_WAVE_DATA_SIZE]; //Samples of the last TRIGGER_HISTORY_DEPTH S_INTs in trigger mode, used by the S_INT bottom half only
+    //Written by the producer
+    unsigned int iNextSequence ____cacheline_aligned_in_smp; //Sequence number expected by the next published frame, any gap is reported as overrun
+    unsigned int iReclaimedFrames; //Frames reclaimed since the last published frame, reported as overrun
+    unsigned int iRejectedFrames; //Frames rejected by trigger mode since the last published frame, not reported as overrun
+    unsigned long lTotalFrames; //Statistics: frames published
+    unsigned long lTotalOverruns; //Statistics: frames dropped
+};
+static struct interrupt_demo_ring arrDataRings[DATA_CHANNEL_MAX_COUNT]; //One Frame Ring per channel
+static int iDataRingDepth = DATA_RING_DEFAULT_DEPTH; //Module parameter, rounded up to a power of 2
+module_param(iDataRingDepth, int, S_IRUGO);
+MODULE_PARM_DESC(iDataRingDepth, "Number of frames in Frame Ring (rounded up to a power of 2)");
+static int iDataRingOverflowMode = DATA_RING_OVERFLOW_DROP_NEWEST; //Module parameter, one of DATA_RING_OVERFLOW_*
+module_param(iDataRingOverflowMode, int, S_IRUGO);
+MODULE_PARM_DESC(iDataRingOverflowMode, "When Frame Ring is full: 0 = drop the newest frame (default), 1 = overwrite the oldest frame");
+
+//Readers
+//Every open file has a read cursor per channel into the shared Frame Rings, frames are never copied per reader inside the driver.
+//A frame slot written for counter n has seqcount 2 * ((n >> iDepthShift) + 1), so a reader knows whether the slot still holds its frame without any shared state.
+struct interrupt_demo_reader {
+    struct list_head lstNode; //Node in lstReaders
+    unsigned int arrCursors[DATA_CHANNEL_MAX_COUNT]; //Counter of the next frame to read from each channel
+    unsigned long lDroppedFrames; //Frames overwritten before this reader read them
+    unsigned int iWakeupThreshold; //Number of unread frames which make this reader readable, set by CTL_CMD_SET_WAKEUP_THRESHOLD
+    unsigned int iWakeupTimeout; //Microseconds the oldest unread frame may wait before this reader is readable anyway, 0 if none, set by CTL_CMD_SET_WAKEUP_TIMEOUT
+    unsigned int iWakeupAlign; //One of CTL_ARG_WAKEUP_ALIGN_*, set by CTL_CMD_SET_WAKEUP_ALIGN
+    struct hrtimer hrtWakeupTimer; //Wakes waiters up when the timeout of the oldest unread frame expires
+    u64 lWakeupExpiry; //Expiry hrtWakeupTimer is armed for, in nanoseconds of CLOCK_MONOTONIC, 0 if not armed
+};
+static LIST_HEAD(lstReaders); //Open files which have called read(), protected by mtxDataRingReadLock. Files only used for IO control or mmap() never hold frames back
+
+//Wakeup Alignment
+//Each DP_INT tick takes a snapshot of Frame Ring heads, readers aligned to DP_INT check their wakeup policy against it instead of the live heads
+static seqcount_t scDpIntTick; //Written by DP_INT handler only
+static unsigned int arrDpIntHeads[DATA_CHANNEL_MAX_COUNT]; //iHead of each Frame Ring at the last DP_INT tick
+static u64 lDpIntTimestamp; //Time of the last DP_INT tick, in nanoseconds of CLOCK_MONOTONIC
+static atomic_t iAlignedReaders = ATOMIC_INIT(0); //Number of open files aligned to DP_INT, DP_INT wakes consumers up only if there is any
+
+//Channels
+static int iDataChannelCount __read_mostly = 1; //Module parameter, number of channels in use
+module_param(iDataChannelCount, int, S_IRUGO);
+MODULE_PARM_DESC(iDataChannelCount, "Number of channels acquired on each S_INT (1 to 4)");
+static unsigned int iCurrentChannel __read_mostly = 0; //Channel selected by CTL_CMD_SET_CHANNEL, or CTL_ARG_CHANNEL_ALL
+static unsigned int iChannelLayout __read_mostly = CTL_ARG_CHANNEL_LAYOUT_PLANAR; //Layout of read() when iCurrentChannel is CTL_ARG_CHANNEL_ALL, one of CTL_ARG_CHANNEL_LAYOUT_*
+static unsigned int arrChannelFrameBuffer[DATA_CHANNEL_MAX_COUNT][DATA_BUFFER_SIZE]; //Frames of all channels copied out of Frame Rings for interleaving, protected by mtxDataRingReadLock
+static unsigned int arrInterleavedBuffer[DATA_CHANNEL_MAX_COUNT * DATA_BUFFER_SIZE]; //Interleaved frames of all channels, protected by mtxDataRingReadLock
+
+//S_INT Event Queue
+//Single-consumer ring of S_INT events between the top half and the bottom half of S_INT. The consumer is serialized by spnlkDataBufferLock.
+struct interrupt_demo_s_int_event {
+    unsigned int iSequence; //Sequence number of S_INT
+    u64 lTimestamp; //Time S_INT arrived, in nanoseconds
+};
+struct interrupt_demo_s_int_queue {
+    //Written by the top half
+    unsigned int iHead; //Producer counter, written by the top half only
+    unsigned int iSequence; //Sequence number of the next S_INT
+    unsigned long lTotalDropped; //Statistics: events dropped because the queue was full
+    u64 lMaxResidency; //Statistics: max time spent in the top half, in nanoseconds
+    u64 lTotalResidency; //Statistics: total time spent in the top half, in nanoseconds
+    unsigned long lTotalEvents; //Statistics: S_INTs handled by the top half
+    //Written by the bottom half
+    unsigned int iTail ____cacheline_aligned_in_smp; //Consumer counter, written by the bottom half only
+    struct interrupt_demo_s_int_event arrEvents[S_INT_EVENT_QUEUE_DEPTH] ____cacheline_aligned_in_smp;
+};
+static struct interrupt_demo_s_int_queue queSIntEventQueue;
+static int iSIntBottomHalfMode __read_mostly = S_INT_BOTTOM_HALF_THREADED_IRQ; //Module parameter, one of S_INT_BOTTOM_HALF_*
+module_param(iSIntBottomHalfMode, int, S_IRUGO);
+MODULE_PARM_DESC(iSIntBottomHalfMode, "Where S_INT frames are filled: 0 = hard IRQ, 1 = threaded IRQ (default), 2 = workqueue");
+static struct workqueue_struct * lpSIntWorkqueue; //Workqueue of S_INT bottom half, used in S_INT_BOTTOM_HALF_WORKQUEUE mode
+static int iSIntCpu __read_mostly = S_INT_CPU_ANY; //Module parameter, CPU S_INT and its bottom half run on
+module_param(iSIntCpu, int, S_IRUGO);
+MODULE_PARM_DESC(iSIntCpu, "CPU to run S_INT and its bottom half on, -1 = any CPU (default)");
+static struct work_struct wkSIntBottomHalf; //Work item of S_INT bottom half
+
+//IRQ Lines
+//Each entry of arrIrqLines describes an interrupt, and is its dev_id. Every line is requested with DispatchIrq() as top half, which counts the interrupt then calls the handler of the line,
+//so an edge type, a thread function, a CPU or a protection is changed in the table without touching the handlers.
+#define IRQ_LINE_DEBOUNCED       0x01 //Masked for iKeyDebounceTime after each interrupt
+#define IRQ_LINE_STORM_PROTECTED 0x02 //Masked for IRQ_STORM_BACKOFF_TIME when it exceeds iIrqStormLimit interrupts per second
+struct interrupt_demo_irq_line {
+    const char * lpszName; //Name of the interrupt
+    unsigned int iArgument; //CTL_ARG_IRQ_NAME_* selecting this line
+    unsigned int iIrq; //IRQ number, or index of simulated interrupt source
+#ifndef IS_SIMULATED_INTERRUPT_SOURCE
+    unsigned int iGpio; //GPIO label of the interrupt pin
+#endif
+    unsigned long lFlags; //Trigger type and IRQF_* flags
+    irq_handler_t lpHandler; //Interrupt handler
+    irq_handler_t lpThreadFunction; //Thread function, NULL if the interrupt isn't threaded
+    int iCpu; //CPU the interrupt runs on, or S_INT_CPU_ANY
+    unsigned int iProtection; //IRQ_LINE_DEBOUNCED and IRQ_LINE_STORM_PROTECTED
+    bool bIsRequested; //Set when the interrupt is obtained, so exit() frees only what init() has obtained
+    unsigned long lEvents; //Number of interrupts, written by DispatchIrq() of this line only (handlers of a line never nest)
+    unsigned long lShownEvents; //lEvents when debugfs has last shown it
+    unsigned long lStorms; //Number of IRQ storms, written by DispatchIrq() of this line only
+    u64 lStormWindowStart; //Start of the current one-second storm window, in nanoseconds of CLOCK_MONOTONIC
+    unsigned int iStormWindowEvents; //Interrupts in the current storm window
+    struct hrtimer hrtRearmTimer; //Unmasks the line after its debounce time or storm backoff
+};
+static unsigned int iKeyDebounceTime __read_mostly = IRQ_DEFAULT_DEBOUNCE_TIME; //Module parameter, debounce time of GPIO keys in microseconds
+module_param(iKeyDebounceTime, uint, S_IRUGO);
+MODULE_PARM_DESC(iKeyDebounceTime, "Microseconds a GPIO key stays masked after an interrupt, 0 disables debouncing (default 20000)");
+static unsigned int iIrqStormLimit __read_mostly = IRQ_DEFAULT_STORM_LIMIT; //Module parameter, interrupts per second above which an auxiliary line is masked
+module_param(iIrqStormLimit, uint, S_IRUGO);
+MODULE_PARM_DESC(iIrqStormLimit, "Interrupts per second above which PW_INT or a GPIO key is masked for a while, 0 disables storm protection (default 1000)");
+static struct interrupt_demo_irq_line * arrIrqLinesByArgument[CTL_ARG_IRQ_NAME_MAX + 1]; //IRQ line of each CTL_ARG_IRQ_NAME_*, NULL if none, filled by init()
+
+//IRQ Event FIFO
+//Multi-producer ring of records of auxiliary interrupts, queued by their handlers on any CPU. A producer reserves a slot with cmpxchg() on iHead, then commits it by writing iCommit,
+//so producers never lock, never print and never wait for each other. The consumer is serialized by mtxIrqEventReadLock, it takes committed slots in order and releases them by advancing iTail.
+struct interrupt_demo_irq_event_slot {
+    unsigned int iCommit; //Counter of the record in this slot plus 1, written once the record is complete
+    struct interrupt_demo_irq_event evtEvent;
+};
+struct interrupt_demo_irq_event_fifo {
+    //Written by producers
+    unsigned int iHead; //Counter of the next slot to reserve, free-running
+    atomic_t iDropped; //Records dropped because the FIFO was full
+    //Written by the consumer
+    unsigned int iTail ____cacheline_aligned_in_smp; //Counter of the next record to read, free-running
+    struct interrupt_demo_irq_event_slot arrSlots[IRQ_EVENT_FIFO_DEPTH] ____cacheline_aligned_in_smp;
+};
+static struct interrupt_demo_irq_event_fifo fifIrqEvents;
+
+//Playback Ring
+//Single-producer single-consumer ring of blocks, the mirror of Frame Ring: the producer (write() or a user space process through mmap()) only writes iHead, DAC_INT only writes iTail.
+//DAC_INT never plays a block in place, it copies the block into the idle half of a double buffer and releases the slot at once, so the producer may refill it while the copy is being played.
+struct interrupt_demo_playback {
+    //Read mostly
+    unsigned int iDepth; //Number of blocks, must be a power of 2
+    unsigned long lMapSize; //Size of lpControl area, including Control Page and blocks
+    struct interrupt_demo_playback_control * lpControl; //Control Page, beginning of the vmalloc_user() area
+    unsigned int (*lpBlocks)[PLAYBACK_BLOCK_SAMPLES]; //Block storage, iDepth blocks following Control Page
+    atomic_t iWriters; //Number of files open for writing, 0 or 1
+    unsigned long lOpenPlayedBlocks; //lPlayedBlocks when the device was opened for writing, underruns are only counted once a block of this writer has been played
+    //Written by DAC_INT
+    unsigned int arrBuffers[2][PLAYBACK_BLOCK_SAMPLES] ____cacheline_aligned_in_smp; //Double buffer, one half is played while the other one is pre-filled
+    unsigned int iActiveBuffer; //Half of arrBuffers the converter is playing
+    bool bIsPrefilled; //The other half holds the next block
+    bool bIsHolding; //The active half is a held sample, not a block
+    const unsigned int * lpDacBlock; //Block handed to the converter. The board has no DAC driver, a real one would point its DMA or FIFO refill at it here
+    unsigned long lPlayedBlocks; //Statistics: blocks handed to the converter
+};
+static struct interrupt_demo_playback plbPlayback;
+static int iPlaybackRingDepth = PLAYBACK_RING_DEFAULT_DEPTH; //Module parameter, rounded up to a power of 2
+module_param(iPlaybackRingDepth, int, S_IRUGO);
+MODULE_PARM_DESC(iPlaybackRingDepth, "Number of blocks in Playback Ring (rounded up to a power of 2)");
+
+#ifdef IS_SIMULATED_INTERRUPT_SOURCE
+//Simulated Interrupt Source
+//Each simulated interrupt is an hrtimer calling the interrupt handler in hard IRQ context. Handlers returning IRQ_WAKE_THREAD wake a kthread running the thread function, like a threaded IRQ.
+struct interrupt_demo_simulated_irq {
+    const char * lpszName; //Name of the interrupt, also the name of the kthread
+    irq_handler_t lpHandler; //Interrupt handler
+    irq_handler_t lpThreadFunction; //Thread function, NULL if the interrupt isn't threaded
+    void * lpDevId; //dev_id passed to lpHandler and lpThreadFunction
+    struct hrtimer hrtTimer; //Timer generating the interrupt
+    ktime_t ktPeriod; //Period of the timer
+    atomic_t iDisableDepth; //Nested depth of DisableDemoIrq(), the interrupt is generated only when it's 0
+    struct task_struct * lpThread; //kthread running lpThreadFunction
+    int iCpu; //CPU the timer and the kthread run on, or S_INT_CPU_ANY
+    unsigned long lThreadFlags; //Bit 0 is set when lpThreadFunction should run
+};
+static struct interrupt_demo_simulated_irq arrSimulatedIrqs[SIMULATED_IRQ_COUNT];
+static int arrSimulatedIrqRates[SIMULATED_IRQ_COUNT] = {50, 50, 0, 0}; //Module parameter, rate of S_INT, DP_INT, PW_INT and DAC_INT in Hz
+module_param_array(arrSimulatedIrqRates, int, NULL, S_IRUGO);
+MODULE_PARM_DESC(arrSimulatedIrqRates, "Rates of simulated S_INT, DP_INT, PW_INT and DAC_INT in Hz, 0 disables an interrupt (default 50,50,0,0)");
+#endif
+
+//Statistics
+//Counters live in per-CPU storage, so updating them needs neither locks nor atomic operations. They are only summed up when debugfs is read.
+#define IS_IRQ_STATISTICS_REQUESTED //Switch of IRQ and read() latency statistics
+#ifdef IS_IRQ_STATISTICS_REQUESTED
+struct interrupt_demo_irq_stats {
+    unsigned long lCount; //Number of IRQs handled
+    unsigned long arrDuration[STATS_HISTOGRAM_BUCKETS]; //Time spent in the handler
+    unsigned long arrJitter[STATS_HISTOGRAM_BUCKETS]; //Difference between two consecutive inter-arrival times
+};
+struct interrupt_demo_stats {
+    struct interrupt_demo_irq_stats arrIrqs[STATS_IRQ_COUNT];
+    unsigned long lReadCount; //Number of frames returned by read()
+    unsigned long arrReadLatency[STATS_HISTOGRAM_BUCKETS]; //Time from S_INT to the frame being copied to user space by read()
+};
+static DEFINE_PER_CPU(struct interrupt_demo_stats, pcpuStats);
+static u64 arrIrqLastArrival[STATS_IRQ_COUNT]; //Arrival time of the previous IRQ, written by the handler of that IRQ only (handlers of a line never nest)
+static u64 arrIrqLastInterval[STATS_IRQ_COUNT]; //Previous inter-arrival time, written by the handler of that IRQ only
+static const char * arrIrqStatsNames[STATS_IRQ_COUNT] = {S_INT_NAME, XEINT20_NAME, PW_INT_NAME, DAC_INT_NAME};
+static struct dentry * lpStatsDebugfsDir; //debugfs directory of statistics
+#endif
+
+//Waveform Generator
+//Samples are a waveform template plus noise from a per-CPU xorshift32 generator, so generating a frame takes neither locks nor divisions.
+//Templates are published with RCU: the producer reads the current one without locking, a replaced template is freed after a grace period.
+struct interrupt_demo_template {
+    struct rcu_head rcuHead;
+    unsigned int arrSamples[DATA_BUFFER_WAVE_DATA_SIZE];
+};
+static struct interrupt_demo_template tmpBuiltinTemplate; //Copy of arrDataDef, slot WAVEFORM_TEMPLATE_BUILTIN
+static struct interrupt_demo_template __rcu * arrTemplates[WAVEFORM_TEMPLATE_COUNT]; //Template slots, NULL if not loaded. Writers are serialized by mtxTemplateLock
+static struct mutex mtxTemplateLock; //Mutex to serialize template loaders, copy_from_user() may sleep
+static DEFINE_PER_CPU(unsigned int, pcpuNoiseState); //State of xorshift32 noise generator, never 0
+
+//Acquisition Settings
+//Settings of new frames are an immutable snapshot published with RCU: the S_INT bottom half reads the current one once per S_INT without locking, so reconfiguring never stalls acquisition and an S_INT never mixes two settings.
+//IO control commands change setPendingSettings under mtxIoCtlLock, then PublishSettings() replaces the snapshot by a copy of it. A replaced snapshot is freed after a grace period.
+struct interrupt_demo_settings {
+    unsigned int arrChannelGains[DATA_CHANNEL_MAX_COUNT]; //Gain of each channel, in 1/16
+    unsigned int iDelay; //Set by CTL_CMD_SET_DELAY*, reported by CTL_IOC_GET_CONFIG
+    unsigned int iCompressCount; //Number of points merged into an output sample
+    unsigned int iCompressStep; //Distance between output samples in input points, fixed-point with COMPRESS_STEP_FRACTION_BITS decimal bits. 0 means iCompressCount
+    unsigned int iCompressMode; //One of CTL_ARG_COMPRESS_MODE_*
+    unsigned int iSampleFormat; //Format of new frames, one of CTL_ARG_SAMPLE_FORMAT_*
+    unsigned int iTemplate; //Waveform template slot of new frames, set by CTL_CMD_SET_TEMPLATE
+    unsigned int iPulseMode; //One of CTL_ARG_PULSE_MODE_*
+    unsigned int iPulseBaseline; //Flat level of the waveform
+    unsigned int iPulseThreshold; //Height above iPulseBaseline a sample must exceed to belong to a pulse
+    unsigned int iTriggerMode; //One of CTL_ARG_TRIGGER_MODE_*
+    unsigned int iTriggerLevel; //Level samples are compared with
+    unsigned int iTriggerChannel; //Trigger source channel
+    unsigned int iTriggerPreFrames; //Frames published before the trigger frame
+    unsigned int iTriggerPostFrames; //Frames published after the trigger frame
+    unsigned int iTriggerHoldoff; //Frames after a window during which triggers are ignored
+    struct rcu_head rcuHead; //Last, so settings are compared up to it
+};
+static struct interrupt_demo_settings setDefaultSettings = { //Settings at load time, published until the first change and never freed
+    .arrChannelGains = {DATA_GAIN_UNITY, DATA_GAIN_UNITY, DATA_GAIN_UNITY, DATA_GAIN_UNITY},
+    .iCompressCount = 1,
+    .iCompressMode = CTL_ARG_COMPRESS_MODE_MEAN,
+    .iSampleFormat = CTL_ARG_SAMPLE_FORMAT_U32,
+    .iTemplate = WAVEFORM_TEMPLATE_BUILTIN,
+    .iPulseMode = CTL_ARG_PULSE_MODE_OFF,
+    .iPulseBaseline = PULSE_DEFAULT_BASELINE,
+    .iPulseThreshold = PULSE_DEFAULT_THRESHOLD,
+    .iTriggerMode = CTL_ARG_TRIGGER_MODE_OFF,
+    .iTriggerLevel = TRIGGER_DEFAULT_LEVEL,
+};
+static struct interrupt_demo_settings setPendingSettings; //Settings changed by IO control commands, protected by mtxIoCtlLock
+static struct interrupt_demo_settings __rcu * lpCurrentSettings; //Published settings, read by the S_INT bottom half under rcu_read_lock(). Writers are serialized by mtxIoCtlLock
+
+//Compression
+static unsigned int arrRawWaveBuffer[DATA_BUFFER_WAVE_DATA_SIZE] __cacheline_aligned_in_smp; //Uncompressed wave data, used by the S_INT bottom half only
+
+//Sample Format
+static unsigned int arrSampleBuffer[DATA_BUFFER_WAVE_DATA_SIZE]; //Compressed wave data waiting to be encoded, used by the S_INT bottom half only
+static unsigned int arrDecodeBuffer[DATA_BUFFER_WAVE_DATA_SIZE] __cacheline_aligned_in_smp; //Decoded wave data for interleaving, protected by mtxDataRingReadLock
+
+//Trigger
+//Settings are part of Acquisition Settings, the state is used by the S_INT bottom half only
+struct interrupt_demo_trigger {
+    unsigned int iHistoryHead; //Next slot of lpTriggerHistory of every Frame Ring, free-running
+    unsigned int iPendingFrames; //S_INTs in history, neither published nor rejected yet
+    unsigned int iPostFrames; //Frames of the open window still to publish
+    unsigned int iHoldoffFrames; //Frames still to reject before the next trigger
+    unsigned int iLastSample; //Last sample of the trigger source channel, to find edges across frames
+    struct interrupt_demo_s_int_event arrEvents[TRIGGER_HISTORY_DEPTH]; //S_INT events of the frames in history
+};
+static struct interrupt_demo_trigger trgTrigger __cacheline_aligned_in_smp;
+
+//Read Mode
+static unsigned int iReadMode __read_mostly = CTL_ARG_READ_MODE_SINGLE_FRAME; //One of CTL_ARG_READ_MODE_*
+
+/* Character Device Related Functions */
+//Timer callback of a reader's wakeup timeout, runs in hard IRQ context
+static enum hrtimer_restart WakeupTimerCallback(struct hrtimer * lpTimer) {
+    container_of(lpTimer, struct interrupt_demo_reader, hrtWakeupTimer)->lWakeupExpiry = 0;
+    wake_up_interruptible(&wqDataRingReadQueue); //Waiters check their own policy
+    return HRTIMER_NORESTART;
+}
+
+int interrupt_demo_open(struct inode * lpNode, struct file * lpFile) {
+    //DBGPRINT("Device file opening...\n");
+    struct interrupt_demo_reader * lpReader = kzalloc(sizeof(struct interrupt_demo_reader), GFP_KERNEL);
+    if (!lpReader) {
+        return -ENOMEM;
+    }
+    INIT_LIST_HEAD(&lpReader->lstNode); //Joins lstReaders on the first read()
+    lpReader->iWakeupThreshold = 1;
+    InitializeHrtimer(&lpReader->hrtWakeupTimer, WakeupTimerCallback); //Started with absolute expiries, which is the same for CLOCK_MONOTONIC
+    lpFile->private_data = lpReader;
+    return 0;
+}
+
+static int interrupt_demo_release(struct inode * lpNode, struct file * lpFile) {
+    //DBGPRINT("Device file closing...\n");
+    struct interrupt_demo_reader * lpReader = lpFile->private_data;
+    if (!list_empty(&lpReader->lstNode)) {
+        mutex_lock(&mtxDataRingReadLock);
+        list_del(&lpReader->lstNode); //Readers never hold iTail back, nothing to release
+        mutex_unlock(&mtxDataRingReadLock);
+    }
+    hrtimer_cancel(&lpReader->hrtWakeupTimer);
+    if (CTL_ARG_WAKEUP_ALIGN_DP_INT == lpReader->iWakeupAlign) {
+        atomic_dec(&iAlignedReaders);
+    }
+    kfree(lpReader);
+    return 0;
+}
+
+/* Frame Ring Related Functions */
+static int InitializeDataRing(struct interrupt_demo_ring * lpRing, int iDepth, unsigned int iChannel) {
+    unsigned int iRealDepth = DATA_RING_MIN_DEPTH;
+    while (iRealDepth < iDepth && iRealDepth < DATA_RING_MAX_DEPTH) {
+        iRealDepth <<= 1;
+    }
+    memset(lpRing, 0, sizeof(*lpRing));
+    lpRing->iDepth = iRealDepth;
+    lpRing->iDepthShift = ilog2(iRealDepth);
+    lpRing->lMapSize = PAGE_SIZE + PAGE_ALIGN(iRealDepth * sizeof(lpRing->lpFrames[0]));
+    lpRing->lpControl = vmalloc_user(lpRing->lMapSize); //Zeroed and suitable for remap_vmalloc_range()
+    if (!lpRing->lpControl) {
+        return -ENOMEM;
+    }
+    lpRing->lpFrames = (void *)((char *)lpRing->lpControl + PAGE_SIZE);
+    lpRing->lpTriggerHistory = vmalloc(TRIGGER_HISTORY_DEPTH * sizeof(lpRing->lpTriggerHistory[0])); //Private to the driver, not mapped
+    if (!lpRing->lpTriggerHistory) {
+        vfree(lpRing->lpControl);
+        lpRing->lpControl = NULL;
+        return -ENOMEM;
+    }
+    lpRing->lpControl->iDepth = iRealDepth;
+    lpRing->lpControl->iFrameSize = sizeof(lpRing->lpFrames[0]);
+    lpRing->lpControl->iFrameOffset = PAGE_SIZE;
+    lpRing->lpControl->iMapSize = lpRing->lMapSize;
+    lpRing->lpControl->iOverflowMode = iDataRingOverflowMode ? DATA_RING_OVERFLOW_OVERWRITE_OLDEST : DATA_RING_OVERFLOW_DROP_NEWEST;
+    lpRing->lpControl->iChannel = iChannel;
+    lpRing->lpControl->iChannelCount = iDataChannelCount;
+    DBGPRINT("Frame Ring of channel %u, %u frames allocated.\n", iChannel, iRealDepth);
+    return 0;
+}
+
+static void FreeDataRing(struct interrupt_demo_ring * lpRing) {
+    if (!lpRing->lpControl) {
+        return;
+    }
+    NFOPRINT("Frame Ring of channel %u statistics: %lu frames published, %lu frames dropped, %u frames rejected by trigger.\n", lpRing->lpControl->iChannel, lpRing->lTotalFrames, lpRing->lTotalOverruns, lpRing->lpControl->iRejectedFrames);
+    vfree(lpRing->lpTriggerHistory);
+    vfree(lpRing->lpControl);
+    lpRing->lpControl = NULL;
+    lpRing->lpFrames = NULL;
+    lpRing->lpTriggerHistory = NULL;
+}
+
+/* Playback Ring Related Functions */
+static int InitializePlaybackRing(struct interrupt_demo_playback * lpPlayback, int iDepth) {
+    unsigned int iRealDepth = PLAYBACK_RING_MIN_DEPTH;
+    while (iRealDepth < iDepth && iRealDepth < PLAYBACK_RING_MAX_DEPTH) {
+        iRealDepth <<= 1;
+    }
+    memset(lpPlayback, 0, sizeof(*lpPlayback));
+    lpPlayback->iDepth = iRealDepth;
+    lpPlayback->lMapSize = PAGE_SIZE + PAGE_ALIGN(iRealDepth * sizeof(lpPlayback->lpBlocks[0]));
+    lpPlayback->lpControl = vmalloc_user(lpPlayback->lMapSize); //Zeroed and suitable for remap_vmalloc_range()
+    if (!lpPlayback->lpControl) {
+        return -ENOMEM;
+    }
+    lpPlayback->lpBlocks = (void *)((char *)lpPlayback->lpControl + PAGE_SIZE);
+    lpPlayback->lpDacBlock = lpPlayback->arrBuffers[0]; //Silence until the first block
+    lpPlayback->lpControl->iDepth = iRealDepth;
+    lpPlayback->lpControl->iBlockSize = sizeof(lpPlayback->lpBlocks[0]);
+    lpPlayback->lpControl->iBlockOffset = PAGE_SIZE;
+    lpPlayback->lpControl->iMapSize = lpPlayback->lMapSize;
+    lpPlayback->lpControl->iLowWatermark = GetMin(PLAYBACK_DEFAULT_LOW_WATERMARK, iRealDepth - 1);
+    DBGPRINT("Playback Ring, %u blocks allocated.\n", iRealDepth);
+    return 0;
+}
+
+static void FreePlaybackRing(struct interrupt_demo_playback * lpPlayback) {
+    if (!lpPlayback->lpControl) {
+        return;
+    }
+    NFOPRINT("Playback Ring statistics: %lu blocks played, %u underruns.\n", lpPlayback->lPlayedBlocks, lpPlayback->lpControl->iUnderruns);
+    vfree(lpPlayback->lpControl);
+    lpPlayback->lpControl = NULL;
+    lpPlayback->lpBlocks = NULL;
+}
+
+/* Compression Related Functions */
+//Inner loops of compression, kept branch-free over contiguous points so that the compiler can unroll them
+static inline unsigned int GetWindowSum(const unsigned int * __restrict lpWindow, unsigned int iCount) {
+    unsigned int iSum = 0;
+    unsigned int i;
+    for (i = 0; i < iCount; ++i) {
+        iSum += lpWindow[i];
+    }
+    return iSum;
+}
+static inline unsigned int GetWindowMin(const unsigned int * __restrict lpWindow, unsigned int iCount) {
+    unsigned int iMin = lpWindow[0];
+    unsigned int i;
+    for (i = 1; i < iCount; ++i) {
+        iMin = lpWindow[i] < iMin ? lpWindow[i] : iMin;
+    }
+    return iMin;
+}
+static inline unsigned int GetWindowMax(const unsigned int * __restrict lpWindow, unsigned int iCount) {
+    unsigned int iMax = lpWindow[0];
+    unsigned int i;
+    for (i = 1; i < iCount; ++i) {
+        iMax = lpWindow[i] > iMax ? lpWindow[i] : iMax;
+    }
+    return iMax;
+}
+
+/*
+ * CompressWaveData() Function
+ *
+ * This function merges every iCount input points into an output sample, and moves iStep input points forward for the next one.
+ * iStep is a fixed-point number with COMPRESS_STEP_FRACTION_BITS decimal bits. Only whole windows are output.
+ * Only integer arithmetic is used, for floating point isn't allowed in kernel. The mean is divided by a reciprocal, which is exact for 32-bit sums of less than 2^32 / iCount.
+ * Returns the number of output samples.
+ *
+ */
+static unsigned int CompressWaveData(unsigned int * __restrict lpOutput, const unsigned int * __restrict lpInput, unsigned int iInputCount, unsigned int iCount, unsigned int iStep, unsigned int iMode) {
+    unsigned int iOutputCount = 0;
+    unsigned int iPosition = 0; //Fixed-point position in lpInput
+    unsigned int iReciprocal = iCount > 1 ? GetReciprocal(iCount) : 0;
+    while ((iPosition >> COMPRESS_STEP_FRACTION_BITS) + iCount <= iInputCount) {
+        const unsigned int * lpWindow = lpInput + (iPosition >> COMPRESS_STEP_FRACTION_BITS);
+        switch (iMode) {
+        case CTL_ARG_COMPRESS_MODE_MIN:
+            lpOutput[iOutputCount] = GetWindowMin(lpWindow, iCount);
+            break;
+        case CTL_ARG_COMPRESS_MODE_MAX:
+            lpOutput[iOutputCount] = GetWindowMax(lpWindow, iCount);
+            break;
+        default:
+            lpOutput[iOutputCount] = iReciprocal ? DivideByReciprocal(GetWindowSum(lpWindow, iCount), iReciprocal) : lpWindow[0];
+            break;
+        }
+        ++iOutputCount;
+        iPosition += iStep;
+    }
+    return iOutputCount;
+}
+
+/*
+ * EncodeWaveData() Function
+ *
+ * This function encodes iCount samples into the wave data zone of lpFrame in format *lpFormat, and returns the number of Bytes written.
+ * If the samples don't fit, they are stored as CTL_ARG_SAMPLE_FORMAT_U32 instead, and *lpFormat is updated.
+ *
+ */
+static unsigned int EncodeWaveData(unsigned int * lpFrame, const unsigned int * lpSamples, unsigned int iCount, unsigned int * lpFormat) {
+    unsigned int iSize;
+    switch (*lpFormat) {
+    case CTL_ARG_SAMPLE_FORMAT_U16:
+        return EncodeSamples16((unsigned short *)lpFrame, lpSamples, iCount);
+    case CTL_ARG_SAMPLE_FORMAT_DELTA_VARINT:
+        iSize = EncodeSamplesDeltaVarint((unsigned char *)lpFrame, DATA_BUFFER_WAVE_DATA_SIZE * sizeof(unsigned int), lpSamples, iCount);
+        if (iSize) {
+            return iSize;
+        }
+        break;
+    }
+    *lpFormat = CTL_ARG_SAMPLE_FORMAT_U32;
+    memcpy(lpFrame, lpSamples, iCount * sizeof(unsigned int));
+    return iCount * sizeof(unsigned int);
+}
 
-//Data Buffers
-unsigned int arrDataBuffer[DATA_BUFFER_SIZE] = {0};
-unsigned char arrCommandBuffer[CONTROL_COMMAND_BUFFER_SIZE] = {0};
+/*
+ * ExtractPulses() Function
+ *
+ * This function finds pulses in iCount samples and stores the pulse list in the wave data zone of lpFrame, at the first 4-Byte boundary from Byte iOffset.
+ * Samples above iPulseBaseline + iPulseThreshold of lpSettings belong to a pulse.
+ * Pulses beyond the room left in wave data zone or PULSE_MAX_COUNT are counted only. *lpPulseCount receives both counts, as in DATA_EXTRA_PULSE_COUNT.
+ * Returns the number of valid Bytes of wave data zone, including the pulse list.
+ *
+ */
+static unsigned int ExtractPulses(const struct interrupt_demo_settings * lpSettings, unsigned int * lpFrame, unsigned int iOffset, const unsigned int * lpSamples, unsigned int iCount, unsigned int * lpPulseCount) {
+    unsigned int iBaseline = lpSettings->iPulseBaseline;
+    unsigned int iLevel = iBaseline + lpSettings->iPulseThreshold;
+    unsigned int iListOffset = ALIGN(iOffset, sizeof(unsigned int));
+    unsigned int iCapacity = GetMin((DATA_BUFFER_WAVE_DATA_SIZE * sizeof(unsigned int) - iListOffset) / sizeof(struct interrupt_demo_pulse), PULSE_MAX_COUNT);
+    struct interrupt_demo_pulse * lpPulses = (struct interrupt_demo_pulse *)((char *)lpFrame + iListOffset);
+    struct interrupt_demo_pulse plsPulse;
+    unsigned int i, iStored = 0, iDetected = 0;
+    bool bIsInPulse = false;
+    memset((char *)lpFrame + iOffset, 0, iListOffset - iOffset); //Padding
+    for (i = 0; i <= iCount; ++i) {
+        if (i < iCount && lpSamples[i] > iLevel) {
+            if (!bIsInPulse) {
+                bIsInPulse = true;
+                plsPulse.iStart = i;
+                plsPulse.iPeakPosition = i;
+                plsPulse.iReserved = 0;
+                plsPulse.iAmplitude = 0;
+                plsPulse.iArea = 0;
+            }
+            if (lpSamples[i] - iBaseline > plsPulse.iAmplitude) {
+                plsPulse.iAmplitude = lpSamples[i] - iBaseline;
+                plsPulse.iPeakPosition = i;
+            }
+            plsPulse.iArea += lpSamples[i] - iBaseline;
+        }
+        else if (bIsInPulse) { //Falling edge, or the pulse is cut by the end of the frame
+            bIsInPulse = false;
+            plsPulse.iWidth = i - plsPulse.iStart;
+            if (iStored < iCapacity) {
+                lpPulses[iStored++] = plsPulse;
+            }
+            ++iDetected;
+        }
+    }
+    *lpPulseCount = (iDetected << 16) | iStored;
+    return iListOffset + iStored * sizeof(struct interrupt_demo_pulse);
+}
+
+/*
+ * GenerateWaveData() Function
+ *
+ * This function fills lpOutput with DATA_BUFFER_WAVE_DATA_SIZE samples of waveform template iTemplate plus noise, applying iGain in the same pass.
+ * One xorshift32 step gives the noise of two samples, the noise is scaled by a multiply and a shift instead of %, for Cortex-A9 has no hardware divider.
+ *
+ */
+static void GenerateWaveData(unsigned int * __restrict lpOutput, unsigned int iTemplate, unsigned int iGain) {
+    BUILD_BUG_ON(DATA_BUFFER_WAVE_DATA_SIZE % 2);
+    BUILD_BUG_ON(DATA_MAX_VALUE > 0xFFFF);
+    rcu_read_lock();
+    const struct interrupt_demo_template * lpTemplate = rcu_dereference(arrTemplates[iTemplate]);
+    if (!lpTemplate) { //Slot replaced by nothing, can't happen as slots are never unloaded, but stay safe
+        lpTemplate = &tmpBuiltinTemplate;
+    }
+    const unsigned int * lpSamples = lpTemplate->arrSamples;
+    unsigned int * lpState = &get_cpu_var(pcpuNoiseState);
+    unsigned int iState = *lpState;
+    int i;
+    for (i = 0; i < DATA_BUFFER_WAVE_DATA_SIZE; i += 2) {
+        iState = GetNextXorshift32(iState);
+        lpOutput[i] = ((lpSamples[i] + (((iState & 0xFFFF) * DATA_MAX_VALUE) >> 16)) * iGain) >> DATA_GAIN_FRACTION_BITS;
+        lpOutput[i + 1] = ((lpSamples[i + 1] + (((iState >> 16) * DATA_MAX_VALUE) >> 16)) * iGain) >> DATA_GAIN_FRACTION_BITS;
+    }
+    *lpState = iState;
+    put_cpu_var(pcpuNoiseState);
+    rcu_read_unlock();
+}
+
+/*
+ * LoadWaveformTemplate() Function
+ *
+ * This function loads a waveform template from user RAM space into a slot, for CTL_IOC_LOAD_TEMPLATE. Short templates are repeated to fill a frame.
+ * The new template replaces the old one atomically, frames being generated keep using the old one, which is freed after an RCU grace period.
+ *
+ */
+static long LoadWaveformTemplate(const struct interrupt_demo_template_load __user * lpLoad) {
+    struct interrupt_demo_template_load tldLoad;
+    if (copy_from_user(&tldLoad, lpLoad, sizeof(tldLoad))) {
+        return -EFAULT;
+    }
+    if (WAVEFORM_TEMPLATE_BUILTIN == tldLoad.iSlot || tldLoad.iSlot >= WAVEFORM_TEMPLATE_COUNT || 0 == tldLoad.iCount || tldLoad.iCount > DATA_BUFFER_WAVE_DATA_SIZE) {
+        WRNPRINT("Invalid template of %u samples for slot %u.\n", tldLoad.iCount, tldLoad.iSlot);
+        return -EINVAL;
+    }
+    struct interrupt_demo_template * lpTemplate = kmalloc(sizeof(struct interrupt_demo_template), GFP_KERNEL);
+    if (!lpTemplate) {
+        return -ENOMEM;
+    }
+    if (copy_from_user(lpTemplate->arrSamples, (const void __user *)(unsigned long)tldLoad.lpSamples, tldLoad.iCount * sizeof(unsigned int))) {
+        kfree(lpTemplate);
+        return -EFAULT;
+    }
+    unsigned int i;
+    for (i = 0; i < tldLoad.iCount; ++i) {
+        if (lpTemplate->arrSamples[i] > WAVEFORM_TEMPLATE_MAX_SAMPLE) {
+            WRNPRINT("Template sample %u (%u) exceeds %u.\n", i, lpTemplate->arrSamples[i], WAVEFORM_TEMPLATE_MAX_SAMPLE);
+            kfree(lpTemplate);
+            return -EINVAL;
+        }
+    }
+    for (i = tldLoad.iCount; i < DATA_BUFFER_WAVE_DATA_SIZE; ++i) {
+        lpTemplate->arrSamples[i] = lpTemplate->arrSamples[i - tldLoad.iCount];
+    }
+    mutex_lock(&mtxTemplateLock);
+    struct interrupt_demo_template * lpOldTemplate = rcu_dereference_protected(arrTemplates[tldLoad.iSlot], lockdep_is_held(&mtxTemplateLock));
+    rcu_assign_pointer(arrTemplates[tldLoad.iSlot], lpTemplate);
+    mutex_unlock(&mtxTemplateLock);
+    if (lpOldTemplate) {
+        kfree_rcu(lpOldTemplate, rcuHead);
+    }
+    DBGPRINT("Template of %u samples loaded into slot %u.\n", tldLoad.iCount, tldLoad.iSlot);
+    return 0;
+}
+
+//Builds the built-in template and seeds the noise generator of every CPU, called by init()
+static void InitializeWaveformGenerator(void) {
+    unsigned int iCpu;
+    memcpy(tmpBuiltinTemplate.arrSamples, arrDataDef, sizeof(tmpBuiltinTemplate.arrSamples));
+    RCU_INIT_POINTER(arrTemplates[WAVEFORM_TEMPLATE_BUILTIN], &tmpBuiltinTemplate);
+    mutex_init(&mtxTemplateLock);
+    for_each_possible_cpu(iCpu) {
+        per_cpu(pcpuNoiseState, iCpu) = random32() | 1; //xorshift32 gets stuck at 0
+    }
+}
+
+//Frees loaded templates, called by exit() after all producers have stopped
+static void FreeWaveformTemplates(void) {
+    unsigned int iSlot;
+    rcu_barrier(); //Wait for pending kfree_rcu()
+    for (iSlot = 0; iSlot < WAVEFORM_TEMPLATE_COUNT; ++iSlot) {
+        if (WAVEFORM_TEMPLATE_BUILTIN != iSlot) {
+            kfree(rcu_dereference_protected(arrTemplates[iSlot], 1));
+        }
+        RCU_INIT_POINTER(arrTemplates[iSlot], NULL);
+    }
+}
+
+/*
+ * PublishSettings() Function
+ *
+ * This function publishes a copy of setPendingSettings to the S_INT bottom half, if it differs from the published one. Callers must hold mtxIoCtlLock.
+ * An S_INT being processed keeps using the old copy, which is freed after an RCU grace period.
+ * Returns 0, or -ENOMEM, in which case changes stay pending until the next successful call.
+ *
+ */
+static long PublishSettings(void) {
+    struct interrupt_demo_settings * lpOldSettings = rcu_dereference_protected(lpCurrentSettings, 1);
+    if (0 == memcmp(lpOldSettings, &setPendingSettings, offsetof(struct interrupt_demo_settings, rcuHead))) {
+        return 0;
+    }
+    struct interrupt_demo_settings * lpSettings = kmemdup(&setPendingSettings, sizeof(struct interrupt_demo_settings), GFP_KERNEL);
+    if (!lpSettings) {
+        WRNPRINT("Failed to allocate settings, changes are not published yet.\n");
+        return -ENOMEM;
+    }
+    rcu_assign_pointer(lpCurrentSettings, lpSettings);
+    if (lpOldSettings != &setDefaultSettings) {
+        kfree_rcu(lpOldSettings, rcuHead);
+    }
+    return 0;
+}
+
+//Publishes the default settings, called by init() before any S_INT
+static void InitializeSettings(void) {
+    setPendingSettings = setDefaultSettings;
+    RCU_INIT_POINTER(lpCurrentSettings, &setDefaultSettings);
+}
+
+//Frees published settings, called by exit() after all producers have stopped and FreeWaveformTemplates() has waited for pending kfree_rcu()
+static void FreeSettings(void) {
+    struct interrupt_demo_settings * lpSettings = rcu_dereference_protected(lpCurrentSettings, 1);
+    if (lpSettings != &setDefaultSettings) {
+        kfree(lpSettings);
+    }
+    RCU_INIT_POINTER(lpCurrentSettings, NULL);
+}
+
+/*
+ * ProduceFrame() Function
+ *
+ * This function generates the frame of an S_INT event into the head slot of Frame Ring with lpSettings and publishes it, applying iGain while generating samples.
+ * If lpSamples isn't NULL, the samples were generated earlier (by trigger mode) and iGain is ignored.
+ * If the ring is full, either this frame is dropped, or the oldest unread frame is reclaimed, according to iOverflowMode in Control Page.
+ * Lost frames are reported in the overrun counter of the next published frame.
+ * The producer never waits for consumers: the slot seqcount is odd while the frame is being written, consumers retry instead.
+ * Callers must hold spnlkDataBufferLock (if requested) and rcu_read_lock() of lpSettings.
+ *
+ */
+static void ProduceFrame(struct interrupt_demo_ring * lpRing, const struct interrupt_demo_settings * lpSettings, const struct interrupt_demo_s_int_event * lpEvent, unsigned int * lpSamples, unsigned int iGain) {
+    unsigned int iHead = lpRing->lpControl->iHead;
+    unsigned int iTail = ACCESS_ONCE(lpRing->lpControl->iTail);
+    if (iHead - iTail >= lpRing->iDepth) { //Ring is full
+        ++lpRing->lTotalOverruns;
+        if (DATA_RING_OVERFLOW_OVERWRITE_OLDEST != ACCESS_ONCE(lpRing->lpControl->iOverflowMode)) {
+            return; //Drop this frame
+        }
+        //Reclaim the oldest frame. If cmpxchg() fails, a consumer has just released it, which is as good
+        if (cmpxchg(&lpRing->lpControl->iTail, iTail, iTail + 1) == iTail) {
+            ++lpRing->iReclaimedFrames;
+        }
+        else {
+            --lpRing->lTotalOverruns;
+        }
+    }
+    unsigned int * lpFrame = lpRing->lpFrames[iHead & (lpRing->iDepth - 1)];
+    unsigned int iWriteSequence = lpFrame[DATA_EXTRA_WRITE_SEQUENCE];
+    ACCESS_ONCE(lpFrame[DATA_EXTRA_WRITE_SEQUENCE]) = iWriteSequence + 1; //Odd, writing
+    smp_wmb(); //Seqcount must be visible before frame contents
+    unsigned int iCount = GetMax(lpSettings->iCompressCount, 1);
+    unsigned int iStep = lpSettings->iCompressStep;
+    if (0 == iStep) {
+        iStep = iCount << COMPRESS_STEP_FRACTION_BITS;
+    }
+    bool bIsCompressed = iCount > 1 || iStep > (1 << COMPRESS_STEP_FRACTION_BITS);
+    unsigned int iFormat = lpSettings->iSampleFormat;
+    bool bIsEncoded = CTL_ARG_SAMPLE_FORMAT_U32 != iFormat;
+    unsigned int iExtractMode = lpSettings->iPulseMode;
+    unsigned int * lpRawData = lpSamples ? lpSamples : arrRawWaveBuffer;
+    unsigned int * lpWaveData = (bIsCompressed || bIsEncoded || CTL_ARG_PULSE_MODE_OFF != iExtractMode) ? lpRawData : lpFrame; //Generate in place when samples are published as they are
+    if (!lpSamples) {
+        GenerateWaveData(lpWaveData, lpSettings->iTemplate, iGain);
+    }
+    else if (lpWaveData == lpFrame) {
+        memcpy(lpFrame, lpSamples, DATA_BUFFER_WAVE_DATA_SIZE * sizeof(unsigned int));
+    }
+    unsigned int iSampleCount = DATA_BUFFER_WAVE_DATA_SIZE, iWaveDataSize, iPulseCount = 0;
+    if (CTL_ARG_PULSE_MODE_EVENTS == iExtractMode) { //No samples
+        iSampleCount = 0;
+        iFormat = CTL_ARG_SAMPLE_FORMAT_U32;
+        iWaveDataSize = 0;
+    }
+    else {
+        if (bIsCompressed) {
+            lpWaveData = bIsEncoded ? arrSampleBuffer : lpFrame;
+            iSampleCount = CompressWaveData(lpWaveData, lpRawData, DATA_BUFFER_WAVE_DATA_SIZE, GetMin(iCount, DATA_BUFFER_WAVE_DATA_SIZE), iStep, lpSettings->iCompressMode);
+        }
+        if (bIsEncoded) {
+            iWaveDataSize = EncodeWaveData(lpFrame, lpWaveData, iSampleCount, &iFormat);
+        }
+        else {
+            if (lpWaveData != lpFrame) { //Kept aside for pulse extraction
+                memcpy(lpFrame, lpWaveData, iSampleCount * sizeof(unsigned int));
+            }
+            iWaveDataSize = iSampleCount * sizeof(unsigned int);
+        }
+    }
+    if (CTL_ARG_PULSE_MODE_OFF != iExtractMode) {
+        iWaveDataSize = ExtractPulses(lpSettings, lpFrame, iWaveDataSize, lpRawData, DATA_BUFFER_WAVE_DATA_SIZE, &iPulseCount);
+    }
+    lpFrame[DATA_EXTRA_SAMPLE_COUNT] = iSampleCount;
+    lpFrame[DATA_EXTRA_WAVE_DATA_SIZE] = iWaveDataSize;
+    lpFrame[DATA_EXTRA_SAMPLE_FORMAT] = iFormat;
+    lpFrame[DATA_EXTRA_PULSE_COUNT] = iPulseCount;
+    lpFrame[DATA_EXTRA_SEQUENCE] = lpEvent->iSequence;
+    lpFrame[DATA_EXTRA_OVERRUN_COUNT] = lpEvent->iSequence - lpRing->iNextSequence + lpRing->iReclaimedFrames - lpRing->iRejectedFrames;
+    lpFrame[DATA_EXTRA_TIMESTAMP_LOW] = (unsigned int)lpEvent->lTimestamp;
+    lpFrame[DATA_EXTRA_TIMESTAMP_HIGH] = (unsigned int)(lpEvent->lTimestamp >> 32);
+    lpRing->iNextSequence = lpEvent->iSequence + 1;
+    lpRing->iReclaimedFrames = 0;
+    lpRing->iRejectedFrames = 0;
+    ++lpRing->lTotalFrames;
+    smp_wmb(); //Frame contents must be visible before seqcount
+    ACCESS_ONCE(lpFrame[DATA_EXTRA_WRITE_SEQUENCE]) = iWriteSequence + 2; //Even, stable
+    smp_wmb(); //Frame must be visible before the new head
+    ACCESS_ONCE(lpRing->lpControl->iHead) = iHead + 1;
+}
+
+//Returns the counter of the next frame a reader will read from a channel
+//Until its first read(), a reader counts from iTail, like mmap() consumers
+static inline unsigned int GetReaderCursor(struct interrupt_demo_reader * lpReader, unsigned int iChannel) {
+    return list_empty(&lpReader->lstNode) ? ACCESS_ONCE(arrDataRings[iChannel].lpControl->iTail) : ACCESS_ONCE(lpReader->arrCursors[iChannel]);
+}
+
+//Returns the number of frames of a channel published but not read yet by a reader, more than iDepth if the reader has lost frames
+static inline unsigned int GetUnreadFrames(struct interrupt_demo_reader * lpReader, unsigned int iChannel) {
+    return ACCESS_ONCE(arrDataRings[iChannel].lpControl->iHead) - GetReaderCursor(lpReader, iChannel);
+}
+
+//Adds a reader to lstReaders on its first read(), starting from iTail of each ring. Callers must hold mtxDataRingReadLock
+static void AttachReader(struct interrupt_demo_reader * lpReader) {
+    unsigned int iChannel;
+    if (!list_empty(&lpReader->lstNode)) {
+        return;
+    }
+    for (iChannel = 0; iChannel < iDataChannelCount; ++iChannel) {
+        lpReader->arrCursors[iChannel] = ACCESS_ONCE(arrDataRings[iChannel].lpControl->iTail);
+    }
+    list_add_tail(&lpReader->lstNode, &lstReaders);
+}
+
+/*
+ * IsChannelReadable() Function
+ *
+ * This function returns true if a channel meets the wakeup policy of a reader at time lNow, counting the frames published before iHead.
+ * Otherwise, *lpExpiry receives the time its wakeup timeout will expire, or stays 0 if it has no unread frame or no timeout.
+ * The timestamp of the oldest unread frame is read without checking its seqcount, a torn or reclaimed frame only moves the wakeup a little.
+ *
+ */
+static bool IsChannelReadable(struct interrupt_demo_reader * lpReader, unsigned int iChannel, unsigned int iHead, u64 lNow, u64 * lpExpiry) {
+    struct interrupt_demo_ring * lpRing = &arrDataRings[iChannel];
+    unsigned int iCursor = GetReaderCursor(lpReader, iChannel);
+    int iUnreadFrames = iHead - iCursor; //Negative if an aligned reader has read frames published after the snapshot
+    unsigned int iTimeout = ACCESS_ONCE(lpReader->iWakeupTimeout);
+    if (iUnreadFrames <= 0) {
+        return false;
+    }
+    if ((unsigned int)iUnreadFrames >= ACCESS_ONCE(lpReader->iWakeupThreshold)) {
+        return true;
+    }
+    if (0 == iTimeout) {
+        return false;
+    }
+    const unsigned int * lpFrame = lpRing->lpFrames[iCursor & (lpRing->iDepth - 1)];
+    u64 lExpiry = (ACCESS_ONCE(lpFrame[DATA_EXTRA_TIMESTAMP_LOW]) | ((u64)ACCESS_ONCE(lpFrame[DATA_EXTRA_TIMESTAMP_HIGH]) << 32)) + (u64)iTimeout * NSEC_PER_USEC;
+    if (lNow >= lExpiry) {
+        return true;
+    }
+    *lpExpiry = lExpiry;
+    return false;
+}
+
+/*
+ * IsReaderReadable() Function
+ *
+ * This function returns true if the channel selected by CTL_CMD_SET_CHANNEL meets the wakeup policy of a reader (every channel does, for CTL_ARG_CHANNEL_ALL), see header file.
+ * If it doesn't yet but will when a timeout expires, the wakeup timer of the reader is armed, so waiters are woken up even if no other frame comes.
+ *
+ */
+static bool IsReaderReadable(struct interrupt_demo_reader * lpReader) {
+    unsigned int arrHeads[DATA_CHANNEL_MAX_COUNT];
+    unsigned int iChannel = ACCESS_ONCE(iCurrentChannel), iFirstChannel = iChannel, iLastChannel = iChannel;
+    bool bIsAligned = CTL_ARG_WAKEUP_ALIGN_DP_INT == ACCESS_ONCE(lpReader->iWakeupAlign);
+    bool bIsReadable = true, bCanExpire = true;
+    u64 lNow = 0, lExpiry = 0;
+    if (CTL_ARG_CHANNEL_ALL == iChannel) {
+        iFirstChannel = 0;
+        iLastChannel = iDataChannelCount - 1;
+    }
+    if (bIsAligned) { //Judge by the last DP_INT tick
+        unsigned int iSequence;
+        do {
+            iSequence = read_seqcount_begin(&scDpIntTick);
+            memcpy(arrHeads, arrDpIntHeads, sizeof(arrHeads));
+            lNow = lDpIntTimestamp;
+        } while (read_seqcount_retry(&scDpIntTick, iSequence));
+    }
+    else {
+        for (iChannel = iFirstChannel; iChannel <= iLastChannel; ++iChannel) {
+            arrHeads[iChannel] = ACCESS_ONCE(arrDataRings[iChannel].lpControl->iHead);
+        }
+        if (ACCESS_ONCE(lpReader->iWakeupTimeout)) {
+            lNow = ktime_to_ns(ktime_get());
+        }
+    }
+    for (iChannel = iFirstChannel; iChannel <= iLastChannel; ++iChannel) {
+        u64 lChannelExpiry = 0;
+        if (!IsChannelReadable(lpReader, iChannel, arrHeads[iChannel], lNow, &lChannelExpiry)) {
+            bIsReadable = false;
+            bCanExpire = bCanExpire && lChannelExpiry;
+            if (lChannelExpiry > lExpiry) { //Every channel must be readable
+                lExpiry = lChannelExpiry;
+            }
+        }
+    }
+    if (!bIsReadable && bCanExpire && !bIsAligned && lExpiry != ACCESS_ONCE(lpReader->lWakeupExpiry)) { //Aligned readers are woken up by DP_INT
+        lpReader->lWakeupExpiry = lExpiry;
+        hrtimer_start(&lpReader->hrtWakeupTimer, ns_to_ktime(lExpiry), HRTIMER_MODE_ABS);
+    }
+    return bIsReadable;
+}
+
+//Returns true if the slot of lpFrame still holds the frame of counter iCursor, judging by its seqcount
+static inline bool IsFrameCurrent(struct interrupt_demo_ring * lpRing, unsigned int iCursor, unsigned int iWriteSequence) {
+    return 0 == (((iWriteSequence >> 1) ^ ((iCursor >> lpRing->iDepthShift) + 1)) & (~0U >> lpRing->iDepthShift)); //Compared modulo the number of laps a counter can tell
+}
+
+/*
+ * PeekFrame() Function
+ *
+ * This function returns the frame at a reader's cursor with its seqcount, or NULL if the reader has read every frame.
+ * Frames overwritten before the reader got to them are skipped and counted in *lpDroppedFrames.
+ * Copy the frame, then call ReleaseFrame(). Callers must hold mtxDataRingReadLock.
+ *
+ */
+static unsigned int * PeekFrame(struct interrupt_demo_ring * lpRing, unsigned int * lpCursor, unsigned int * lpWriteSequence, unsigned long * lpDroppedFrames) {
+    for (;;) {
+        unsigned int iCursor = *lpCursor;
+        unsigned int iHead = ACCESS_ONCE(lpRing->lpControl->iHead);
+        if (iHead == iCursor) {
+            return NULL;
+        }
+        if (iHead - iCursor > lpRing->iDepth) { //Lapped by the producer
+            *lpDroppedFrames += iHead - iCursor - lpRing->iDepth;
+            *lpCursor = iCursor = iHead - lpRing->iDepth;
+        }
+        smp_rmb(); //Read head before frame contents
+        unsigned int * lpFrame = lpRing->lpFrames[iCursor & (lpRing->iDepth - 1)];
+        unsigned int iWriteSequence = ACCESS_ONCE(lpFrame[DATA_EXTRA_WRITE_SEQUENCE]);
+        if ((iWriteSequence & 1) || !IsFrameCurrent(lpRing, iCursor, iWriteSequence)) { //Being overwritten or overwritten, the frame is lost
+            ++*lpDroppedFrames;
+            ++*lpCursor;
+            continue;
+        }
+        smp_rmb(); //Read seqcount before frame contents
+        *lpWriteSequence = iWriteSequence;
+        return lpFrame;
+    }
+}
+
+/*
+ * ReleaseFrame() Function
+ *
+ * This function advances a reader's cursor past a frame returned by PeekFrame() after it's copied.
+ * Returns false if the producer has torn the frame during the copy, then the copy must be discarded and retried from PeekFrame(), which skips the lost frame.
+ *
+ */
+static bool ReleaseFrame(unsigned int * lpFrame, unsigned int * lpCursor, unsigned int iWriteSequence) {
+    smp_rmb(); //Finish reading frame contents before rereading seqcount
+    if (ACCESS_ONCE(lpFrame[DATA_EXTRA_WRITE_SEQUENCE]) != iWriteSequence) {
+        return false;
+    }
+    ACCESS_ONCE(*lpCursor) = *lpCursor + 1;
+    return true;
+}
+
+/*
+ * UpdateDataRingTail() Function
+ *
+ * This function advances iTail of a channel's Frame Ring to the fastest reader's cursor, so the producer only drops new frames when even the fastest reader is a whole ring behind.
+ * Slower readers are lapped instead, each one skips the frames it lost and counts them in its own lDroppedFrames (see PeekFrame()), so an idle open file never holds the others back.
+ * iTail never moves backwards, which keeps the iTail protocol of mmap() consumers intact. Callers must hold mtxDataRingReadLock.
+ *
+ */
+static void UpdateDataRingTail(unsigned int iChannel) {
+    struct interrupt_demo_ring * lpRing = &arrDataRings[iChannel];
+    struct interrupt_demo_reader * lpReader;
+    unsigned int iTail = ACCESS_ONCE(lpRing->lpControl->iTail);
+    long lMaxDistance = 0;
+    list_for_each_entry(lpReader, &lstReaders, lstNode) {
+        lMaxDistance = GetMax(lMaxDistance, (int)(lpReader->arrCursors[iChannel] - iTail)); //Negative if the reader is behind iTail
+    }
+    if (0 == lMaxDistance) {
+        return;
+    }
+    smp_mb(); //Finish reading frame contents before releasing the slots
+    cmpxchg(&lpRing->lpControl->iTail, iTail, iTail + (unsigned int)lMaxDistance); //Fails only if the producer has reclaimed frames meanwhile, the next read() catches up
+}
+
+#ifdef IS_IRQ_STATISTICS_REQUESTED
+//Returns the histogram bucket of a value in nanoseconds
+static inline unsigned int GetStatsBucket(u64 lValue) {
+    return GetMin(fls64(lValue), STATS_HISTOGRAM_BUCKETS - 1);
+}
+
+//Records the arrival of an IRQ and returns the arrival time for StatsIrqExit(), called at the beginning of an interrupt handler
+static inline u64 StatsIrqEnter(unsigned int iIrqIndex) {
+    u64 lArrival = ktime_to_ns(ktime_get());
+    u64 lLastArrival = arrIrqLastArrival[iIrqIndex];
+    if (lLastArrival) {
+        u64 lInterval = lArrival - lLastArrival;
+        u64 lLastInterval = arrIrqLastInterval[iIrqIndex];
+        if (lLastInterval) {
+            __this_cpu_inc(pcpuStats.arrIrqs[iIrqIndex].arrJitter[GetStatsBucket(lInterval > lLastInterval ? lInterval - lLastInterval : lLastInterval - lInterval)]);
+        }
+        arrIrqLastInterval[iIrqIndex] = lInterval;
+    }
+    arrIrqLastArrival[iIrqIndex] = lArrival;
+    return lArrival;
+}
+
+//Records the handler duration of an IRQ, called at the end of an interrupt handler
+static inline void StatsIrqExit(unsigned int iIrqIndex, u64 lArrival) {
+    __this_cpu_inc(pcpuStats.arrIrqs[iIrqIndex].lCount);
+    __this_cpu_inc(pcpuStats.arrIrqs[iIrqIndex].arrDuration[GetStatsBucket(ktime_to_ns(ktime_get()) - lArrival)]);
+}
+
+//Records the latency from S_INT (lTimestamp of the frame) to read(), called in process context
+static inline void StatsRecordReadLatency(u64 lTimestamp) {
+    u64 lNow = ktime_to_ns(ktime_get());
+    this_cpu_inc(pcpuStats.lReadCount);
+    this_cpu_inc(pcpuStats.arrReadLatency[GetStatsBucket(lNow > lTimestamp ? lNow - lTimestamp : 0)]);
+}
+
+//Prints the sum of a per-CPU histogram, skipping empty buckets
+static void ShowStatsHistogram(struct seq_file * lpSeqFile, const char * lpszName, size_t iOffset) {
+    unsigned int i;
+    int iCpu;
+    seq_printf(lpSeqFile, "  %s:\n", lpszName);
+    for (i = 0; i < STATS_HISTOGRAM_BUCKETS; ++i) {
+        unsigned long lCount = 0;
+        for_each_possible_cpu(iCpu) {
+            lCount += ((const unsigned long *)((const char *)&per_cpu(pcpuStats, iCpu) + iOffset))[i];
+        }
+        if (lCount) {
+            seq_printf(lpSeqFile, "    < %llu ns: %lu\n", 1ULL << i, lCount);
+        }
+    }
+}
+
+/*
+ * interrupt_demo_stats_show() Function
+ *
+ * This function prints all statistics to /sys/kernel/debug/interrupt-demo/histograms.
+ *
+ */
+static int interrupt_demo_stats_show(struct seq_file * lpSeqFile, void * lpData) {
+    unsigned int iIrqIndex;
+    unsigned long lCount;
+    int iCpu;
+    for (iIrqIndex = 0; iIrqIndex < STATS_IRQ_COUNT; ++iIrqIndex) {
+        lCount = 0;
+        for_each_possible_cpu(iCpu) {
+            lCount += per_cpu(pcpuStats, iCpu).arrIrqs[iIrqIndex].lCount;
+        }
+        seq_printf(lpSeqFile, "%s: %lu IRQs\n", arrIrqStatsNames[iIrqIndex], lCount);
+        ShowStatsHistogram(lpSeqFile, "Handler duration", offsetof(struct interrupt_demo_stats, arrIrqs[iIrqIndex].arrDuration));
+        ShowStatsHistogram(lpSeqFile, "Inter-arrival jitter", offsetof(struct interrupt_demo_stats, arrIrqs[iIrqIndex].arrJitter));
+    }
+    lCount = 0;
+    for_each_possible_cpu(iCpu) {
+        lCount += per_cpu(pcpuStats, iCpu).lReadCount;
+    }
+    seq_printf(lpSeqFile, "read(): %lu frames\n", lCount);
+    ShowStatsHistogram(lpSeqFile, "S_INT to read() latency", offsetof(struct interrupt_demo_stats, arrReadLatency));
+    return 0;
+}
+
+static int interrupt_demo_stats_open(struct inode * lpNode, struct file * lpFile) {
+    return single_open(lpFile, interrupt_demo_stats_show, NULL);
+}
+
+//Clears all statistics, executed when writing anything to /sys/kernel/debug/interrupt-demo/reset
+static ssize_t interrupt_demo_stats_reset(struct file * lpFile, const char __user * lpszBuffer, size_t iSize, loff_t * lpOffset) {
+    int iCpu;
+    for_each_possible_cpu(iCpu) {
+        memset(&per_cpu(pcpuStats, iCpu), 0, sizeof(struct interrupt_demo_stats)); //Racing updates may survive, that's fine for statistics
+    }
+    memset(arrIrqLastArrival, 0, sizeof(arrIrqLastArrival));
+    memset(arrIrqLastInterval, 0, sizeof(arrIrqLastInterval));
+    DBGPRINT("Statistics are reset.\n");
+    return iSize;
+}
+
+static const struct file_operations interrupt_demo_stats_file_operations = {
+    .owner = THIS_MODULE,
+    .open = interrupt_demo_stats_open,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
+static const struct file_operations interrupt_demo_stats_reset_file_operations = {
+    .owner = THIS_MODULE,
+    .write = interrupt_demo_stats_reset,
+};
+#endif
+
+/*
+ * QueueSIntEvent() Function
+ *
+ * This function is the S_INT top half: it timestamps an S_INT and queues it for the bottom half, nothing else.
+ * If S_INT Event Queue is full, the event is dropped and shows up as a sequence gap.
+ * Callers must hold spnlkSIntEventLock with interrupts disabled on the local CPU.
+ *
+ */
+static void QueueSIntEvent(struct interrupt_demo_s_int_queue * lpQueue) {
+    ktime_t ktArrival = ktime_get();
+    unsigned int iHead = lpQueue->iHead;
+    unsigned int iSequence = lpQueue->iSequence++;
+    if (iHead - ACCESS_ONCE(lpQueue->iTail) >= S_INT_EVENT_QUEUE_DEPTH) { //Bottom half is too late, drop this event
+        ++lpQueue->lTotalDropped;
+    }
+    else {
+        struct interrupt_demo_s_int_event * lpEvent = &lpQueue->arrEvents[iHead & (S_INT_EVENT_QUEUE_DEPTH - 1)];
+        lpEvent->iSequence = iSequence;
+        lpEvent->lTimestamp = ktime_to_ns(ktArrival);
+        smp_wmb(); //Event must be visible before the new head
+        ACCESS_ONCE(lpQueue->iHead) = iHead + 1;
+    }
+    //Measure hard IRQ residency of the top half
+    u64 lResidency = ktime_to_ns(ktime_sub(ktime_get(), ktArrival));
+    lpQueue->lTotalResidency += lResidency;
+    if (lResidency > lpQueue->lMaxResidency) {
+        lpQueue->lMaxResidency = lResidency;
+    }
+    ++lpQueue->lTotalEvents;
+}
+
+//Rejects the iCount oldest S_INTs in trigger history, on every channel
+static void RejectTriggerFrames(unsigned int iCount) {
+    unsigned int iChannel;
+    for (iChannel = 0; iChannel < iDataChannelCount; ++iChannel) {
+        arrDataRings[iChannel].iRejectedFrames += iCount;
+        ACCESS_ONCE(arrDataRings[iChannel].lpControl->iRejectedFrames) += iCount;
+    }
+    trgTrigger.iPendingFrames -= iCount;
+}
+
+//Publishes every S_INT in trigger history, oldest first, on every channel
+static void PublishTriggerFrames(const struct interrupt_demo_settings * lpSettings) {
+    while (trgTrigger.iPendingFrames) {
+        unsigned int iSlot = (trgTrigger.iHistoryHead - trgTrigger.iPendingFrames) & (TRIGGER_HISTORY_DEPTH - 1);
+        unsigned int iChannel;
+        for (iChannel = 0; iChannel < iDataChannelCount; ++iChannel) {
+            ProduceFrame(&arrDataRings[iChannel], lpSettings, &trgTrigger.arrEvents[iSlot], arrDataRings[iChannel].lpTriggerHistory[iSlot], 0);
+        }
+        --trgTrigger.iPendingFrames;
+    }
+}
+
+//Returns true if iCount samples meet the trigger. iLastSample is the sample right before them
+static bool IsTriggered(unsigned int iMode, unsigned int iLevel, const unsigned int * lpSamples, unsigned int iCount, unsigned int iLastSample) {
+    unsigned int i;
+    switch (iMode) {
+    case CTL_ARG_TRIGGER_MODE_LEVEL:
+        for (i = 0; i < iCount; ++i) {
+            if (lpSamples[i] >= iLevel) {
+                return true;
+            }
+        }
+        return false;
+    case CTL_ARG_TRIGGER_MODE_RISING:
+        for (i = 0; i < iCount; iLastSample = lpSamples[i++]) {
+            if (iLastSample < iLevel && lpSamples[i] >= iLevel) {
+                return true;
+            }
+        }
+        return false;
+    case CTL_ARG_TRIGGER_MODE_FALLING:
+        for (i = 0; i < iCount; iLastSample = lpSamples[i++]) {
+            if (iLastSample >= iLevel && lpSamples[i] < iLevel) {
+                return true;
+            }
+        }
+        return false;
+    default:
+        return true;
+    }
+}
+
+/*
+ * ProcessTriggeredSIntEvent() Function
+ *
+ * This function is the S_INT bottom half of an event in trigger mode: it generates the samples of every channel into trigger history,
+ * then publishes the frames of a window, or keeps them as pre-trigger frames, or rejects them.
+ * Callers must hold rcu_read_lock() of lpSettings. Returns true if any frame was published.
+ *
+ */
+static bool ProcessTriggeredSIntEvent(const struct interrupt_demo_settings * lpSettings, const struct interrupt_demo_s_int_event * lpEvent) {
+    unsigned int iSlot = trgTrigger.iHistoryHead++ & (TRIGGER_HISTORY_DEPTH - 1);
+    unsigned int iSource = GetMin(lpSettings->iTriggerChannel, iDataChannelCount - 1);
+    unsigned int iChannel;
+    trgTrigger.arrEvents[iSlot] = *lpEvent;
+    for (iChannel = 0; iChannel < iDataChannelCount; ++iChannel) {
+        GenerateWaveData(arrDataRings[iChannel].lpTriggerHistory[iSlot], lpSettings->iTemplate, lpSettings->arrChannelGains[iChannel]);
+    }
+    ++trgTrigger.iPendingFrames;
+    const unsigned int * lpSamples = arrDataRings[iSource].lpTriggerHistory[iSlot];
+    unsigned int iLastSample = trgTrigger.iLastSample;
+    trgTrigger.iLastSample = lpSamples[DATA_BUFFER_WAVE_DATA_SIZE - 1];
+    if (trgTrigger.iPostFrames) { //Window is open
+        PublishTriggerFrames(lpSettings);
+        if (0 == --trgTrigger.iPostFrames) {
+            trgTrigger.iHoldoffFrames = lpSettings->iTriggerHoldoff;
+        }
+        return true;
+    }
+    if (trgTrigger.iHoldoffFrames) {
+        --trgTrigger.iHoldoffFrames;
+        RejectTriggerFrames(trgTrigger.iPendingFrames);
+        return false;
+    }
+    if (IsTriggered(lpSettings->iTriggerMode, lpSettings->iTriggerLevel, lpSamples, DATA_BUFFER_WAVE_DATA_SIZE, iLastSample)) {
+        PublishTriggerFrames(lpSettings); //Pre-trigger frames and the trigger frame
+        trgTrigger.iPostFrames = lpSettings->iTriggerPostFrames;
+        if (0 == trgTrigger.iPostFrames) {
+            trgTrigger.iHoldoffFrames = lpSettings->iTriggerHoldoff;
+        }
+        return true;
+    }
+    unsigned int iPreFrames = GetMin(lpSettings->iTriggerPreFrames, TRIGGER_MAX_PRE_FRAMES);
+    if (trgTrigger.iPendingFrames > iPreFrames) {
+        RejectTriggerFrames(trgTrigger.iPendingFrames - iPreFrames);
+    }
+    return false;
+}
+
+/*
+ * ProcessSIntEvents() Function
+ *
+ * This function is the S_INT bottom half: it turns all queued S_INT events into frames of Frame Ring.
+ * Settings are read from the published snapshot once per event, so it never waits for IO control commands.
+ * Callers must hold spnlkDataBufferLock (if requested).
+ *
+ */
+static void ProcessSIntEvents(struct interrupt_demo_s_int_queue * lpQueue) {
+    unsigned int iTail = lpQueue->iTail;
+    bool bIsPublished = false;
+    if (iTail == ACCESS_ONCE(lpQueue->iHead)) {
+        return;
+    }
+    while (iTail != ACCESS_ONCE(lpQueue->iHead)) {
+        smp_rmb(); //Read head before the event
+        const struct interrupt_demo_s_int_event * lpEvent = &lpQueue->arrEvents[iTail & (S_INT_EVENT_QUEUE_DEPTH - 1)];
+        rcu_read_lock();
+        const struct interrupt_demo_settings * lpSettings = rcu_dereference(lpCurrentSettings);
+        if (CTL_ARG_TRIGGER_MODE_OFF != lpSettings->iTriggerMode) {
+            bIsPublished |= ProcessTriggeredSIntEvent(lpSettings, lpEvent);
+        }
+        else {
+            unsigned int iChannel;
+            if (trgTrigger.iPendingFrames) { //Trigger mode has just been turned off
+                RejectTriggerFrames(trgTrigger.iPendingFrames);
+            }
+            trgTrigger.iPostFrames = 0;
+            trgTrigger.iHoldoffFrames = 0;
+            for (iChannel = 0; iChannel < iDataChannelCount; ++iChannel) {
+                ProduceFrame(&arrDataRings[iChannel], lpSettings, lpEvent, NULL, lpSettings->arrChannelGains[iChannel]);
+            }
+            bIsPublished = true;
+        }
+        rcu_read_unlock();
+        ++iTail;
+        smp_mb(); //Finish reading the event before releasing the slot
+        ACCESS_ONCE(lpQueue->iTail) = iTail;
+    }
+    if (bIsPublished) {
+        wake_up_interruptible(&wqDataRingReadQueue); //Wake up blocking read() and poll() callers, once for all new frames
+    }
+}
+
+/*
+ * TriggerSoftwareSInt() Function
+ *
+ * This function runs the S_INT data path (top half, then bottom half) iCount times from process context, without the S_INT hardware.
+ * It's used to measure throughput and drop rate of Frame Rings on any board. It yields the CPU between S_INTs and stops early if the caller is being killed.
+ *
+ */
+static void TriggerSoftwareSInt(unsigned int iCount) {
+    unsigned long lFlags;
+    while (iCount-- && !fatal_signal_pending(current)) {
+        spin_lock_irqsave(&spnlkSIntEventLock, lFlags); //Serialize with S_INT top half running on other CPUs
+        QueueSIntEvent(&queSIntEventQueue);
+        spin_unlock_irqrestore(&spnlkSIntEventLock, lFlags); //Don't forget to unlock me!
+#ifdef IS_DATA_BUFFER_SPINLOCK_REQUESTED
+        spin_lock_irqsave(&spnlkDataBufferLock, lFlags); //Serialize with S_INT bottom half, it may run in hard IRQ context
+#endif
+        ProcessSIntEvents(&queSIntEventQueue);
+#ifdef IS_DATA_BUFFER_SPINLOCK_REQUESTED
+        spin_unlock_irqrestore(&spnlkDataBufferLock, lFlags); //Don't forget to unlock me!
+#endif
+        cond_resched(); //Callers hold mtxIoCtlLock, but no spin-lock
+    }
+}
+
+//Moves the cursors of channels 0 to (iCount - 1) back by the frame each of them has just released, so a read() of every channel which fails on a later channel takes nothing. Callers must hold mtxDataRingReadLock
+static void UnreadFrames(struct interrupt_demo_reader * lpReader, unsigned int iCount) {
+    while (iCount--) {
+        ACCESS_ONCE(lpReader->arrCursors[iCount]) = lpReader->arrCursors[iCount] - 1; //If the producer has overwritten the frame meanwhile, PeekFrame() counts it as dropped
+    }
+}
+
+/*
+ * CopyFrameToUser() Function
+ *
+ * This function copies the frame at a reader's cursor in a channel's Frame Ring to user RAM space and releases it, retrying if the frame is torn by the producer.
+ * When the frame is compressed, only the valid samples and Extra Data zone are copied.
+ * Returns the number of Bytes of lpszBuffer the frame occupies (a whole Data Buffer, or iSize if it's smaller), -EAGAIN if the ring is empty, or -EFAULT. Callers must hold mtxDataRingReadLock.
+ * On -EFAULT, the frame isn't released, it stays at the cursor for the next read().
+ *
+ */
+static ssize_t CopyFrameToUser(struct interrupt_demo_reader * lpReader, unsigned int iChannel, char __user * lpszBuffer, size_t iSize) {
+    struct interrupt_demo_ring * lpRing = &arrDataRings[iChannel];
+    unsigned int * lpFrame;
+    unsigned int iWriteSequence;
+    u64 lTimestamp;
+    do {
+        lpFrame = PeekFrame(lpRing, &lpReader->arrCursors[iChannel], &iWriteSequence, &lpReader->lDroppedFrames);
+        if (!lpFrame) { //Every unread frame was lost while being peeked
+            return -EAGAIN;
+        }
+        unsigned int iWaveDataSize = GetMin(ACCESS_ONCE(lpFrame[DATA_EXTRA_WAVE_DATA_SIZE]), DATA_BUFFER_WAVE_DATA_SIZE * sizeof(unsigned int)); //Bounded in case the frame is torn
+        lTimestamp = lpFrame[DATA_EXTRA_TIMESTAMP_LOW] | ((u64)lpFrame[DATA_EXTRA_TIMESTAMP_HIGH] << 32);
+        if (copy_to_user(lpszBuffer, lpFrame, GetMin(iWaveDataSize, iSize))) {
+            return -EFAULT;
+        }
+        if (iSize > DATA_BUFFER_WAVE_DATA_SIZE * sizeof(unsigned int)) { //Extra Data zone
+            if (copy_to_user(lpszBuffer + DATA_BUFFER_WAVE_DATA_SIZE * sizeof(unsigned int), lpFrame + DATA_BUFFER_WAVE_DATA_SIZE, GetMin(DATA_BUFFER_EXTRA_DATA_SIZE * sizeof(unsigned int), iSize - DATA_BUFFER_WAVE_DATA_SIZE * sizeof(unsigned int)))) {
+                return -EFAULT;
+            }
+        }
+    } while (!ReleaseFrame(lpFrame, &lpReader->arrCursors[iChannel], iWriteSequence)); //Torn by the producer, copy the next frame instead
+#ifdef IS_IRQ_STATISTICS_REQUESTED
+    StatsRecordReadLatency(lTimestamp);
+#endif
+    return GetMin(iSize, sizeof(lpRing->lpFrames[0]));
+}
+
+//Decodes the wave data zone of a copied frame back to CTL_ARG_SAMPLE_FORMAT_U32 in place, and updates its Extra Data zone
+static void DecodeWaveData(unsigned int * lpFrame) {
+    unsigned int iSampleCount = GetMin(lpFrame[DATA_EXTRA_SAMPLE_COUNT], DATA_BUFFER_WAVE_DATA_SIZE);
+    unsigned int iWaveDataSize = GetMin(lpFrame[DATA_EXTRA_WAVE_DATA_SIZE], DATA_BUFFER_WAVE_DATA_SIZE * sizeof(unsigned int));
+    switch (lpFrame[DATA_EXTRA_SAMPLE_FORMAT]) {
+    case CTL_ARG_SAMPLE_FORMAT_U16:
+        iSampleCount = DecodeSamples16(arrDecodeBuffer, (const unsigned short *)lpFrame, GetMin(iSampleCount, iWaveDataSize / sizeof(unsigned short)));
+        break;
+    case CTL_ARG_SAMPLE_FORMAT_DELTA_VARINT:
+        iSampleCount = DecodeSamplesDeltaVarint(arrDecodeBuffer, iSampleCount, (const unsigned char *)lpFrame, iWaveDataSize);
+        break;
+    default:
+        return;
+    }
+    memcpy(lpFrame, arrDecodeBuffer, iSampleCount * sizeof(unsigned int));
+    lpFrame[DATA_EXTRA_SAMPLE_COUNT] = iSampleCount;
+    lpFrame[DATA_EXTRA_SAMPLE_FORMAT] = CTL_ARG_SAMPLE_FORMAT_U32;
+    lpFrame[DATA_EXTRA_WAVE_DATA_SIZE] = iSampleCount * sizeof(unsigned int);
+    lpFrame[DATA_EXTRA_PULSE_COUNT] = 0; //The pulse list isn't interleaved
+}
+
+/*
+ * CopyInterleavedFramesToUser() Function
+ *
+ * This function takes the frame at a reader's cursor of every channel, interleaves their samples and copies them to user RAM space in one go.
+ * Returns the number of Bytes of lpszBuffer the frames occupy (iDataChannelCount Data Buffers, or iSize if it's smaller), -EAGAIN if a ring is empty, or -EFAULT. On errors, no frame is taken.
+ * Callers must hold mtxDataRingReadLock.
+ *
+ */
+static ssize_t CopyInterleavedFramesToUser(struct interrupt_demo_reader * lpReader, char __user * lpszBuffer, size_t iSize) {
+    unsigned int iChannel, iSampleCount = DATA_BUFFER_WAVE_DATA_SIZE;
+    for (iChannel = 0; iChannel < iDataChannelCount; ++iChannel) {
+        unsigned int * lpFrame;
+        unsigned int iWriteSequence;
+        do {
+            lpFrame = PeekFrame(&arrDataRings[iChannel], &lpReader->arrCursors[iChannel], &iWriteSequence, &lpReader->lDroppedFrames);
+            if (!lpFrame) {
+                UnreadFrames(lpReader, iChannel);
+                return -EAGAIN;
+            }
+            memcpy(arrChannelFrameBuffer[iChannel], lpFrame, sizeof(arrChannelFrameBuffer[0]));
+        } while (!ReleaseFrame(lpFrame, &lpReader->arrCursors[iChannel], iWriteSequence));
+        DecodeWaveData(arrChannelFrameBuffer[iChannel]);
+        iSampleCount = GetMin(iSampleCount, arrChannelFrameBuffer[iChannel][DATA_EXTRA_SAMPLE_COUNT]);
+    }
+#ifdef IS_IRQ_STATISTICS_REQUESTED
+    StatsRecordReadLatency(arrChannelFrameBuffer[0][DATA_EXTRA_TIMESTAMP_LOW] | ((u64)arrChannelFrameBuffer[0][DATA_EXTRA_TIMESTAMP_HIGH] << 32)); //All channels share the S_INT timestamp
+#endif
+    unsigned int i;
+    for (i = 0; i < iSampleCount; ++i) {
+        for (iChannel = 0; iChannel < iDataChannelCount; ++iChannel) {
+            arrInterleavedBuffer[i * iDataChannelCount + iChannel] = arrChannelFrameBuffer[iChannel][i];
+        }
+    }
+    for (iChannel = 0; iChannel < iDataChannelCount; ++iChannel) {
+        memcpy(arrInterleavedBuffer + DATA_BUFFER_WAVE_DATA_SIZE * iDataChannelCount + DATA_BUFFER_EXTRA_DATA_SIZE * iChannel, arrChannelFrameBuffer[iChannel] + DATA_BUFFER_WAVE_DATA_SIZE, DATA_BUFFER_EXTRA_DATA_SIZE * sizeof(unsigned int));
+    }
+    size_t iWaveSize = DATA_BUFFER_WAVE_DATA_SIZE * iDataChannelCount * sizeof(unsigned int);
+    if (copy_to_user(lpszBuffer, arrInterleavedBuffer, GetMin(iSampleCount * iDataChannelCount * sizeof(unsigned int), iSize))) {
+        UnreadFrames(lpReader, iDataChannelCount);
+        return -EFAULT;
+    }
+    if (iSize > iWaveSize) { //Extra Data zones
+        if (copy_to_user(lpszBuffer + iWaveSize, arrInterleavedBuffer + DATA_BUFFER_WAVE_DATA_SIZE * iDataChannelCount, GetMin(DATA_BUFFER_EXTRA_DATA_SIZE * iDataChannelCount * sizeof(unsigned int), iSize - iWaveSize))) {
+            UnreadFrames(lpReader, iDataChannelCount);
+            return -EFAULT;
+        }
+    }
+    return GetMin(iSize, iWaveSize + DATA_BUFFER_EXTRA_DATA_SIZE * iDataChannelCount * sizeof(unsigned int));
+}
+
+/*
+ * CopyPlanarFramesToUser() Function
+ *
+ * This function copies the frame at a reader's cursor of every channel to user RAM space, one Data Buffer after another, as far as iSize goes.
+ * Returns the number of Bytes of lpszBuffer the frames occupy, or the error of the first channel which fails, -EAGAIN or -EFAULT. On errors, no frame is taken.
+ * Callers must hold mtxDataRingReadLock.
+ *
+ */
+static ssize_t CopyPlanarFramesToUser(struct interrupt_demo_reader * lpReader, char __user * lpszBuffer, size_t iSize) {
+    size_t iOffset = 0;
+    unsigned int iChannel;
+    for (iChannel = 0; iChannel < iDataChannelCount && iOffset < iSize; ++iChannel) {
+        ssize_t iResult = CopyFrameToUser(lpReader, iChannel, lpszBuffer + iOffset, iSize - iOffset);
+        if (iResult < 0) {
+            UnreadFrames(lpReader, iChannel);
+            return iResult;
+        }
+        iOffset += iResult;
+    }
+    return iOffset;
+}
+
+//Copies Bytes of a frame record to user RAM space (read()) or kernel RAM space (splice()), returns false if user RAM space is not writable
+static inline bool CopyRecordBytes(char * lpDestination, const void * lpSource, size_t iSize, bool bIsUserBuffer) {
+    if (bIsUserBuffer) {
+        return 0 == copy_to_user((void __user *)lpDestination, lpSource, iSize);
+    }
+    memcpy(lpDestination, lpSource, iSize);
+    return true;
+}
+
+/*
+ * CopyFrameRecord() Function
+ *
+ * This function copies the frame at a reader's cursor in a channel's Frame Ring as a frame record (see header file) and releases it.
+ * lpBuffer is in user RAM space if bIsUserBuffer is true, in kernel RAM space otherwise. Padding is zeroed in kernel RAM space only, it's left untouched in user RAM space.
+ * Returns the size of the record, 0 if it doesn't fit in iSize Bytes, -EAGAIN if the ring is empty, or -EFAULT. Callers must hold mtxDataRingReadLock.
+ *
+ */
+static ssize_t CopyFrameRecord(struct interrupt_demo_reader * lpReader, unsigned int iChannel, char * lpBuffer, size_t iSize, bool bIsUserBuffer) {
+    struct interrupt_demo_ring * lpRing = &arrDataRings[iChannel];
+    struct interrupt_demo_frame_header hdrHeader;
+    unsigned int * lpFrame;
+    unsigned int iWriteSequence;
+    do {
+        lpFrame = PeekFrame(lpRing, &lpReader->arrCursors[iChannel], &iWriteSequence, &lpReader->lDroppedFrames);
+        if (!lpFrame) {
+            return -EAGAIN;
+        }
+        hdrHeader.iDataSize = GetMin(ACCESS_ONCE(lpFrame[DATA_EXTRA_WAVE_DATA_SIZE]), DATA_BUFFER_WAVE_DATA_SIZE * sizeof(unsigned int)); //Bounded in case the frame is torn
+        hdrHeader.iRecordSize = ALIGN(sizeof(hdrHeader) + hdrHeader.iDataSize, FRAME_RECORD_ALIGNMENT);
+        hdrHeader.iSequence = lpFrame[DATA_EXTRA_SEQUENCE];
+        hdrHeader.iOverrunCount = lpFrame[DATA_EXTRA_OVERRUN_COUNT];
+        hdrHeader.lTimestamp = lpFrame[DATA_EXTRA_TIMESTAMP_LOW] | ((u64)lpFrame[DATA_EXTRA_TIMESTAMP_HIGH] << 32);
+        hdrHeader.iChannel = iChannel;
+        hdrHeader.iSampleCount = lpFrame[DATA_EXTRA_SAMPLE_COUNT];
+        hdrHeader.iSampleFormat = lpFrame[DATA_EXTRA_SAMPLE_FORMAT];
+        hdrHeader.iPulseCount = lpFrame[DATA_EXTRA_PULSE_COUNT];
+        if (sizeof(hdrHeader) + hdrHeader.iDataSize > iSize) {
+            return 0; //Not released, it stays at the cursor for the next read()
+        }
+        if (!CopyRecordBytes(lpBuffer + sizeof(hdrHeader), lpFrame, hdrHeader.iDataSize, bIsUserBuffer)) {
+            return -EFAULT;
+        }
+    } while (!ReleaseFrame(lpFrame, &lpReader->arrCursors[iChannel], iWriteSequence)); //Torn by the producer, copy the next frame instead
+    if (!CopyRecordBytes(lpBuffer, &hdrHeader, sizeof(hdrHeader), bIsUserBuffer)) { //The header is a private copy, it's safe to copy after releasing the frame
+        ACCESS_ONCE(lpReader->arrCursors[iChannel]) = lpReader->arrCursors[iChannel] - 1; //Unread it, the record never reached user RAM space
+        return -EFAULT;
+    }
+    if (!bIsUserBuffer) { //Never leak stale kernel RAM through padding
+        memset(lpBuffer + sizeof(hdrHeader) + hdrHeader.iDataSize, 0, GetMin(hdrHeader.iRecordSize, iSize) - sizeof(hdrHeader) - hdrHeader.iDataSize);
+    }
+#ifdef IS_IRQ_STATISTICS_REQUESTED
+    StatsRecordReadLatency(hdrHeader.lTimestamp);
+#endif
+    return GetMin(hdrHeader.iRecordSize, iSize); //Padding of the last record may be cut
+}
+
+//Where a record of a batch starts and which frame it holds, see CopyFrameRecords()
+struct interrupt_demo_record_mark {
+    unsigned int iChannel; //Channel of the frame
+    unsigned int iCursor; //Counter of the frame, the reader's cursor before the frame was read
+    size_t iOffset; //Offset of the record in the batch
+};
 
-/* Character Device Related Functions */
-int interrupt_demo_open(struct inode * lpNode, struct file * lpFile) {
-    //DBGPRINT("Device file opening...\n");
-    return 0;
+/*
+ * CopyFrameRecords() Function
+ *
+ * This function copies as many frame records of the current channel (or all channels in turns) as fit in iSize Bytes, see CopyFrameRecord() for lpBuffer.
+ * If lpMarks isn't NULL, it copies at most *lpRecordCount records, marks where each one starts and which frame it holds, and sets *lpRecordCount to the number copied, so a caller can unread the tail of a batch.
+ * Returns the number of Bytes copied, -EINVAL if not even one record fits, or a negative error code if nothing is copied. Callers must hold mtxDataRingReadLock.
+ *
+ */
+static ssize_t CopyFrameRecords(struct interrupt_demo_reader * lpReader, char * lpBuffer, size_t iSize, bool bIsUserBuffer, struct interrupt_demo_record_mark * lpMarks, unsigned int * lpRecordCount) {
+    unsigned int iChannel = ACCESS_ONCE(iCurrentChannel);
+    unsigned int iFirstChannel = CTL_ARG_CHANNEL_ALL == iChannel ? 0 : iChannel;
+    unsigned int iLastChannel = CTL_ARG_CHANNEL_ALL == iChannel ? iDataChannelCount - 1 : iChannel;
+    unsigned int iMaxRecords = lpMarks ? *lpRecordCount : UINT_MAX;
+    unsigned int iRecords = 0;
+    ssize_t iResult = 0;
+    size_t iCopied = 0;
+    while (iRecords < iMaxRecords) {
+        bool bIsAnyCopied = false;
+        for (iChannel = iFirstChannel; iChannel <= iLastChannel && iRecords < iMaxRecords; ++iChannel) {
+            iResult = CopyFrameRecord(lpReader, iChannel, lpBuffer + iCopied, iSize - iCopied, bIsUserBuffer);
+            if (iResult > 0) {
+                if (lpMarks) {
+                    lpMarks[iRecords].iChannel = iChannel;
+                    lpMarks[iRecords].iCursor = lpReader->arrCursors[iChannel] - 1;
+                    lpMarks[iRecords].iOffset = iCopied;
+                }
+                ++iRecords;
+                iCopied += iResult;
+                bIsAnyCopied = true;
+            }
+            else if (0 == iResult) { //Buffer is full
+                iResult = -EINVAL;
+                goto out;
+            }
+            else if (-EAGAIN != iResult) {
+                goto out;
+            }
+        }
+        if (!bIsAnyCopied) { //All rings are drained
+            break;
+        }
+    }
+out:
+    if (lpMarks) {
+        *lpRecordCount = iRecords;
+    }
+    return iCopied ? iCopied : iResult;
 }
 
-static int interrupt_demo_release(struct inode * lpNode, struct file * lpFile) {
-    //DBGPRINT("Device file closing...\n");
+/*
+ * LockReadableReader() Function
+ *
+ * This function waits until a reader meets its wakeup policy (see header file), and returns 0 with mtxDataRingReadLock held.
+ * Returns -EAGAIN at once if bIsNonBlocking is true, or -ERESTARTSYS if interrupted by a signal, without holding the lock.
+ *
+ */
+static int LockReadableReader(struct interrupt_demo_reader * lpReader, bool bIsNonBlocking) {
+    if (mutex_lock_interruptible(&mtxDataRingReadLock)) {
+        return -ERESTARTSYS;
+    }
+    AttachReader(lpReader);
+    while (!IsReaderReadable(lpReader)) { //Wakeup policy not met
+        mutex_unlock(&mtxDataRingReadLock);
+        if (bIsNonBlocking) {
+            return -EAGAIN;
+        }
+        if (wait_event_interruptible(wqDataRingReadQueue, IsReaderReadable(lpReader))) {
+            return -ERESTARTSYS; //Interrupted by a signal
+        }
+        if (mutex_lock_interruptible(&mtxDataRingReadLock)) {
+            return -ERESTARTSYS;
+        }
+    }
     return 0;
 }
 
 /* 
  * interrupt_demo_read() Function
  *
- * This function copies arrDataBuffer to user RAM space.
+ * This function copies the oldest frame this open file hasn't read in Frame Ring of the current channel (CTL_CMD_SET_CHANNEL) to user RAM space, then releases it.
+ * Every open file has its own cursor, so several consumers get the same frames at their own pace (see header file).
+ * If the current channel is CTL_ARG_CHANNEL_ALL, the oldest unread frame of every channel is copied, in the layout set by CTL_CMD_SET_CHANNEL_LAYOUT (see header file).
+ * In CTL_ARG_READ_MODE_BATCH (set by CTL_CMD_SET_READ_MODE), it copies as many frame records as fit instead, see CopyFrameRecords() and header file. The rest of this comment is about the default single frame mode.
+ * If the wakeup policy of this open file isn't met (CTL_CMD_SET_WAKEUP_*, one unread frame by default, see header file), it sleeps until it is, so a frame is never returned twice.
+ * If the device file is opened with O_NONBLOCK and there is no unread frame, -EAGAIN is returned and nothing is copied.
+ * Returns the number of Bytes of the user space data buffer the frame occupies (a whole Data Buffer per channel, or the buffer size if it's smaller), or -EFAULT if the buffer is not writable.
+ * Older versions returned the number of Bytes NOT copied (0 on success), so user applications should treat any non-negative result as success.
+ * A frame is a whole Data Buffer, whose Extra Data zone contains the sequence number, the overrun counter, the timestamp and the sample count (see header file).
+ * When the frame is compressed or in a compact sample format, only the valid Bytes of wave data zone (DATA_EXTRA_WAVE_DATA_SIZE) and Extra Data zone are copied, the rest of wave data zone in user space data buffer is left untouched.
  * The user space data buffer is an array, whose data type is char (Byte).
- * Thus, the size of user space data buffer must be 4 times of the size of arrDataBuffer (for unsigned int type data).
- * It's suggested that the size of user space data buffer is larger than 4 times of the size of arrDataBuffer (for unsigned int type data) in order to avoid Segmentation Fault.
+ * Thus, the size of user space data buffer must be 4 times of the size of Data Buffer (for unsigned int type data), times the number of channels for CTL_ARG_CHANNEL_ALL.
+ * It's suggested that the size of user space data buffer is larger than 4 times of the size of Data Buffer (for unsigned int type data) in order to avoid Segmentation Fault.
  * To reconstruct data (pesudo C++ code):
  * 
  * [[code type="Cpp"]]
@@ -94,73 +1645,429 @@ static int interrupt_demo_release(struct inode * lpNode, struct file * lpFile) {
  *      arrData[i]=(int(chrData[i*4])) + (int(chrData[i*4+1])<<8) + (int(chrData[i*4+2])<<16) + (int(chrData[i*4+3])<<24);
  * }
  * [[/code]]
+ * On little-endian platforms (including ARM Linux), the buffer can simply be read as an array of unsigned int. See interrupt-demo-bench.c for a complete consumer of every access mode.
  * 
  */
 ssize_t interrupt_demo_read(struct file * lpFile, char __user * lpszBuffer, size_t iSize, loff_t * lpOffset) {
     //DBGPRINT("Reading data from device file...\n");
-    //Sample data reading code
-    disable_irq(S_INT); //Disable S_INT to avoid unwanted DataBuffer refresh
-#ifdef IS_DATA_BUFFER_SPINLOCK_REQUESTED
-    read_lock(&rwlkDataBufferLock); //Begin reading, locks arrDataBuffer
-#endif
+    //Frames are checked by their seqcount instead of masking S_INT, so the producer is never held up by this copy (which may sleep on a page fault)
+    struct interrupt_demo_reader * lpReader = lpFile->private_data;
+    bool bIsNonBlocking = lpFile->f_flags & O_NONBLOCK;
     ssize_t iResult;
-    iResult = copy_to_user(lpszBuffer, arrDataBuffer, GetMin(sizeof(arrDataBuffer), iSize));
-    if (iResult) {
-        WRNPRINT("Failed to copy %ld Bytes of data to user RAM space.\n", iResult);
+    do {
+        iResult = LockReadableReader(lpReader, bIsNonBlocking);
+        if (iResult < 0) {
+            return iResult;
+        }
+        unsigned int iChannel = ACCESS_ONCE(iCurrentChannel);
+        if (CTL_ARG_READ_MODE_BATCH == ACCESS_ONCE(iReadMode)) {
+            iResult = CopyFrameRecords(lpReader, (char __force *)lpszBuffer, iSize, true, NULL, NULL);
+        }
+        else if (CTL_ARG_CHANNEL_ALL != iChannel) {
+            iResult = CopyFrameToUser(lpReader, iChannel, lpszBuffer, iSize);
+        }
+        else if (CTL_ARG_CHANNEL_LAYOUT_INTERLEAVED == iChannelLayout) {
+            iResult = CopyInterleavedFramesToUser(lpReader, lpszBuffer, iSize);
+        }
+        else {
+            iResult = CopyPlanarFramesToUser(lpReader, lpszBuffer, iSize);
+        }
+        for (iChannel = 0; iChannel < iDataChannelCount; ++iChannel) {
+            UpdateDataRingTail(iChannel);
+        }
+        mutex_unlock(&mtxDataRingReadLock);
+    } while (-EAGAIN == iResult && !bIsNonBlocking); //Every unread frame was lost while being copied, wait for the next one
+    return iResult;
+}
+
+#define SPLICE_MAX_RECORDS 64 //Records moved by one splice(), bounds the marks kept on the stack
+
+//Frees pages of a splice() which didn't make it into the pipe
+static void ReleaseSplicePage(struct splice_pipe_desc * lpSpliceDesc, unsigned int iIndex) {
+    put_page(lpSpliceDesc->pages[iIndex]);
+}
+
+DEFINE_PRIVATE_PIPE_BUF_OPERATIONS(interrupt_demo_pipe_buf_operations);
+
+/*
+ * UnspliceFrameRecords() Function
+ *
+ * This function moves a reader's cursors back to the first record of a batch which isn't entirely in the first iSpliced Bytes, so the next read() or splice() delivers it again.
+ * A channel whose cursor has moved since the batch was copied (another read() of the same file) is left alone. Callers must hold mtxDataRingReadLock.
+ *
+ */
+static void UnspliceFrameRecords(struct interrupt_demo_reader * lpReader, const struct interrupt_demo_record_mark * lpMarks, unsigned int iRecordCount, size_t iBatchSize, const unsigned int * lpEndCursors, size_t iSpliced) {
+    unsigned int arrRewindCursors[DATA_CHANNEL_MAX_COUNT];
+    unsigned int iChannel;
+    size_t iRecordEnd = iBatchSize;
+    memcpy(arrRewindCursors, lpEndCursors, sizeof(arrRewindCursors));
+    while (iRecordCount > 0 && iRecordEnd > iSpliced) {
+        --iRecordCount;
+        arrRewindCursors[lpMarks[iRecordCount].iChannel] = lpMarks[iRecordCount].iCursor;
+        iRecordEnd = lpMarks[iRecordCount].iOffset;
     }
-#ifdef IS_DATA_BUFFER_SPINLOCK_REQUESTED
-    read_unlock(&rwlkDataBufferLock); //Don't forget to unlock me!
-#endif
-    enable_irq(S_INT); //Enable S_INT
+    for (iChannel = 0; iChannel < iDataChannelCount; ++iChannel) {
+        if (lpReader->arrCursors[iChannel] == lpEndCursors[iChannel]) {
+            ACCESS_ONCE(lpReader->arrCursors[iChannel]) = arrRewindCursors[iChannel];
+        }
+    }
+}
+
+/*
+ * interrupt_demo_splice_read() Function
+ *
+ * This function moves frames of the current channel (or all channels in turns) into a pipe as frame records (see Batched Read Definitions), whatever the read mode is.
+ * With splice(), a recorder streams frames to a file or a socket without copying them to user RAM space and back.
+ * Each frame is copied once, from Frame Ring into a page given to the pipe, for the producer reuses ring slots while the pipe may hold pages for long.
+ * Each page holds as many whole records as fit and ends on a record boundary, so the pipe, which takes whole pages, never cuts a record. A splice() takes no more pages than the pipe has free buffers.
+ * Records the pipe doesn't take (e.g. another writer has filled it, or a signal arrives while waiting for room) are unread. iTail is only advanced once the outcome is known,
+ * but other readers may advance it meanwhile, so an unread record overwritten by the producer before the next splice() is counted in lDroppedFrames instead.
+ *
+ */
+static ssize_t interrupt_demo_splice_read(struct file * lpFile, loff_t * lpOffset, struct pipe_inode_info * lpPipe, size_t iSize, unsigned int iFlags) {
+    struct interrupt_demo_reader * lpReader = lpFile->private_data;
+    struct page * arrPages[PIPE_DEF_BUFFERS];
+    struct partial_page arrPartialPages[PIPE_DEF_BUFFERS];
+    struct splice_pipe_desc spdSpliceDesc = {
+        .pages = arrPages,
+        .partial = arrPartialPages,
+        .nr_pages = 0,
+        SPLICE_PIPE_DESC_MAX_PAGES(PIPE_DEF_BUFFERS)
+        .flags = iFlags,
+        .ops = &interrupt_demo_pipe_buf_operations,
+        .spd_release = ReleaseSplicePage,
+    };
+    struct interrupt_demo_record_mark arrMarks[SPLICE_MAX_RECORDS];
+    unsigned int iRecordCount = 0;
+    unsigned int arrEndCursors[DATA_CHANNEL_MAX_COUNT];
+    bool bIsNonBlocking = (lpFile->f_flags & O_NONBLOCK) || (iFlags & SPLICE_F_NONBLOCK);
+    unsigned int iPageCount = GetMin(PIPE_DEF_BUFFERS, GetPipeFreeBuffers(lpPipe));
+    unsigned int iChannel;
+    size_t iBatchSize = 0;
+    ssize_t iResult;
+    if (0 == iSize) {
+        return 0;
+    }
+    if (0 == iPageCount) { //Pipe is full
+        if (bIsNonBlocking) {
+            return -EAGAIN;
+        }
+        iPageCount = 1; //splice_to_pipe() waits for room
+    }
+    iResult = LockReadableReader(lpReader, bIsNonBlocking);
+    if (iResult < 0) {
+        return iResult;
+    }
+    while (spdSpliceDesc.nr_pages < iPageCount && iBatchSize < iSize && iRecordCount < SPLICE_MAX_RECORDS) {
+        unsigned int iPageRecordCount = SPLICE_MAX_RECORDS - iRecordCount;
+        unsigned int iRecord;
+        struct page * lpPage = alloc_page(GFP_KERNEL);
+        if (!lpPage) {
+            iResult = -ENOMEM;
+            break;
+        }
+        iResult = CopyFrameRecords(lpReader, page_address(lpPage), GetMin(PAGE_SIZE, iSize - iBatchSize), false, arrMarks + iRecordCount, &iPageRecordCount); //Whole records only
+        if (iResult <= 0) {
+            put_page(lpPage);
+            break;
+        }
+        for (iRecord = iRecordCount; iRecord < iRecordCount + iPageRecordCount; ++iRecord) {
+            arrMarks[iRecord].iOffset += iBatchSize;
+        }
+        iRecordCount += iPageRecordCount;
+        arrPages[spdSpliceDesc.nr_pages] = lpPage;
+        arrPartialPages[spdSpliceDesc.nr_pages].offset = 0;
+        arrPartialPages[spdSpliceDesc.nr_pages].len = iResult;
+        arrPartialPages[spdSpliceDesc.nr_pages].private = 0;
+        ++spdSpliceDesc.nr_pages;
+        iBatchSize += iResult;
+    }
+    memcpy(arrEndCursors, lpReader->arrCursors, sizeof(arrEndCursors));
+    mutex_unlock(&mtxDataRingReadLock);
+    if (0 == spdSpliceDesc.nr_pages) {
+        return iResult; //-EINVAL if len of splice() can't hold a record
+    }
+    iResult = splice_to_pipe(lpPipe, &spdSpliceDesc); //May sleep until the pipe has room, without holding mtxDataRingReadLock
+    mutex_lock(&mtxDataRingReadLock); //Not interruptible, records the pipe didn't take must be unread
+    if (iResult < (ssize_t)iBatchSize) {
+        UnspliceFrameRecords(lpReader, arrMarks, iRecordCount, iBatchSize, arrEndCursors, GetMax(iResult, 0));
+    }
+    for (iChannel = 0; iChannel < iDataChannelCount; ++iChannel) {
+        UpdateDataRingTail(iChannel);
+    }
+    mutex_unlock(&mtxDataRingReadLock);
     return iResult;
 }
 
+/*
+ * interrupt_demo_poll() Function
+ *
+ * This function reports the device as readable when this open file meets its wakeup policy for the current channel (see header file), for poll(), select() and epoll.
+ * The wait queue is woken by S_INT each time frames are published, by the wakeup timer of a file and by DP_INT ticks when files are aligned to them. For a file which has never been read (e.g. an mmap() consumer), unread frames are counted from iTail.
+ *
+ */
+static unsigned int interrupt_demo_poll(struct file * lpFile, poll_table * lpPollTable) {
+    unsigned int iMask = 0;
+    poll_wait(lpFile, &wqDataRingReadQueue, lpPollTable);
+    if (IsReaderReadable(lpFile->private_data)) {
+        iMask |= POLLIN | POLLRDNORM;
+    }
+    return iMask;
+}
+
+/*
+ * interrupt_demo_mmap() Function
+ *
+ * This function maps Control Page and all frames of a channel's Frame Ring to user RAM space, so frames can be consumed in place without read().
+ * The mapping of channel n must start at offset (n * iMapSize) and must not be larger than iMapSize in Control Page. See header file for the layout and the consuming protocol.
+ *
+ */
+static int interrupt_demo_mmap(struct file * lpFile, struct vm_area_struct * lpVma) {
+    DBGPRINT("Mapping %lu Bytes of Frame Ring to user RAM space...\n", lpVma->vm_end - lpVma->vm_start);
+    unsigned long lMapPages = arrDataRings[0].lMapSize >> PAGE_SHIFT;
+    unsigned long lChannel = lpVma->vm_pgoff / lMapPages;
+    if (lpVma->vm_pgoff % lMapPages != 0 || lChannel >= iDataChannelCount || lpVma->vm_end - lpVma->vm_start > arrDataRings[0].lMapSize) {
+        WRNPRINT("Invalid mapping of %lu Bytes at page offset %lu.\n", lpVma->vm_end - lpVma->vm_start, lpVma->vm_pgoff);
+        return -EINVAL;
+    }
+    lpVma->vm_pgoff = 0; //remap_vmalloc_range() takes the offset into the area of this channel
+    return remap_vmalloc_range(lpVma, arrDataRings[lChannel].lpControl, 0);
+}
+
+/*
+ * ProcessReaderCommand() Function
+ *
+ * This function applies an IO control command which only affects the open file it's issued on.
+ * Returns -ENOTTY if the command isn't one of them, then it must be passed to ProcessIoControlCommand().
+ *
+ */
+static long ProcessReaderCommand(struct interrupt_demo_reader * lpReader, unsigned int iIoControlCommand, unsigned long lpIoControlParameters) {
+    switch (iIoControlCommand) {
+    case CTL_CMD_SET_WAKEUP_THRESHOLD:
+        DBGPRINT("Setting wakeup threshold to %lu frames.\n", lpIoControlParameters);
+        ACCESS_ONCE(lpReader->iWakeupThreshold) = GetMin(GetMax(lpIoControlParameters, 1), arrDataRings[0].iDepth);
+        wake_up_interruptible(&wqDataRingReadQueue); //Readiness depends on the threshold
+        return 0;
+    case CTL_CMD_SET_WAKEUP_TIMEOUT:
+        DBGPRINT("Setting wakeup timeout to %lu us.\n", lpIoControlParameters);
+        ACCESS_ONCE(lpReader->iWakeupTimeout) = lpIoControlParameters > UINT_MAX ? UINT_MAX : lpIoControlParameters;
+        wake_up_interruptible(&wqDataRingReadQueue); //Readiness depends on the timeout
+        return 0;
+    case CTL_CMD_SET_WAKEUP_ALIGN:
+        if (lpIoControlParameters > CTL_ARG_WAKEUP_ALIGN_DP_INT) {
+            WRNPRINT("Invalid wakeup alignment %lu.\n", lpIoControlParameters);
+            return -EINVAL;
+        }
+        DBGPRINT("Setting wakeup alignment to %lu.\n", lpIoControlParameters);
+        if (xchg(&lpReader->iWakeupAlign, lpIoControlParameters) != lpIoControlParameters) {
+            if (CTL_ARG_WAKEUP_ALIGN_DP_INT == lpIoControlParameters) {
+                atomic_inc(&iAlignedReaders);
+            }
+            else {
+                atomic_dec(&iAlignedReaders);
+            }
+        }
+        wake_up_interruptible(&wqDataRingReadQueue); //Readiness depends on the alignment
+        return 0;
+    default:
+        return -ENOTTY;
+    }
+}
+
+//Copies the state of an open file to user RAM space, for CTL_IOC_GET_READER_STATS
+static long GetReaderStats(struct interrupt_demo_reader * lpReader, struct interrupt_demo_reader_stats __user * lpStats) {
+    struct interrupt_demo_reader_stats rdsStats;
+    memset(&rdsStats, 0, sizeof(rdsStats));
+    if (mutex_lock_interruptible(&mtxDataRingReadLock)) {
+        return -ERESTARTSYS;
+    }
+    rdsStats.lDroppedFrames = lpReader->lDroppedFrames;
+    rdsStats.iWakeupThreshold = lpReader->iWakeupThreshold;
+    rdsStats.iWakeupTimeout = lpReader->iWakeupTimeout;
+    rdsStats.iWakeupAlign = lpReader->iWakeupAlign;
+    unsigned int iChannel;
+    for (iChannel = 0; iChannel < iDataChannelCount; ++iChannel) {
+        rdsStats.arrUnreadFrames[iChannel] = GetUnreadFrames(lpReader, iChannel);
+    }
+    mutex_unlock(&mtxDataRingReadLock);
+    return copy_to_user(lpStats, &rdsStats, sizeof(rdsStats)) ? -EFAULT : 0;
+}
+
 /* 
  * interrupt_demo_write() Function
  *
- * This function copies IO control commands from user RAM space to kernel RAM space (arrCommandBuffer).
+ * This function copies an IO control command from user RAM space to kernel RAM space (arrCommandBuffer) and processes it.
  * Array arrCommandBuffer has 2 unsigned char (Byte) spaces:
  * The first one (arrCommandBuffer[0]) contains commands (iIoControlCommand);
  * The second one (arrCommandBuffer[1]) contains arguments (lpIoControlParameters);
+ * arrCommandBuffer is on the stack of each caller, so concurrent writers can't overwrite each other's command before it's processed.
  * 
  */
 ssize_t interrupt_demo_write(struct file * lpFile, const char __user * lpszBuffer, size_t iSize, loff_t * lpOffset) {
     DBGPRINT("Writing data to device file...\n");
+    unsigned char arrCommandBuffer[CONTROL_COMMAND_BUFFER_SIZE] = {0};
     ssize_t iResult;
     iResult = copy_from_user(arrCommandBuffer, lpszBuffer, GetMin(CONTROL_COMMAND_BUFFER_SIZE, iSize));
     if (iResult) {
         WRNPRINT("Failed to copy %ld Bytes of data to kernel RAM space.\n", iResult);
         return iResult;
     }
-#ifdef IS_IOCTL_OPERATION_SPINLOCK_REQUESTED
-    spin_lock(&spnlkIoCtlLock); //Locks IoCtl operations
-#endif
     unsigned int iIoControlCommand = arrCommandBuffer[0];
     unsigned long lpIoControlParameters = arrCommandBuffer[1];
     DBGPRINT("IOControl command %u with argument %lu received.\n", iIoControlCommand, lpIoControlParameters);
-    ProcessIoControlCommand(iIoControlCommand, lpIoControlParameters);
-#ifdef IS_IOCTL_OPERATION_SPINLOCK_REQUESTED
-    spin_unlock(&spnlkIoCtlLock); //Don't forget to unlock me!
+#ifdef IS_IOCTL_OPERATION_MUTEX_REQUESTED
+    mutex_lock(&mtxIoCtlLock); //Locks IoCtl operations
+#endif
+    if (-ENOTTY == ProcessReaderCommand(lpFile->private_data, iIoControlCommand, lpIoControlParameters)) {
+        ProcessIoControlCommand(iIoControlCommand, lpIoControlParameters); //write() has always returned 0 for any command, keep it for old user applications
+        PublishSettings();
+    }
+#ifdef IS_IOCTL_OPERATION_MUTEX_REQUESTED
+    mutex_unlock(&mtxIoCtlLock); //Don't forget to unlock me!
+#endif
+    return iResult;
+}
+
+/*
+ * ProcessIoControlBatch() Function
+ *
+ * This function copies a batch of IO control commands from user RAM space, checks all of them, then applies them under one lock.
+ * Settings changed by the batch are published together, so no S_INT sees half of the batch.
+ * Returns 0 on success, or a negative error code if nothing is applied.
+ *
+ */
+static long ProcessIoControlBatch(struct interrupt_demo_reader * lpReader, const struct interrupt_demo_command_batch __user * lpBatch) {
+    struct interrupt_demo_command_batch batBatch;
+    if (copy_from_user(&batBatch, lpBatch, sizeof(batBatch))) {
+        return -EFAULT;
+    }
+    if (0 == batBatch.iCount) {
+        return 0;
+    }
+    if (batBatch.iCount > CTL_BATCH_MAX_COUNT || batBatch.iReserved) {
+        WRNPRINT("Invalid batch of %u commands.\n", batBatch.iCount);
+        return -EINVAL;
+    }
+    struct interrupt_demo_command * lpCommands = memdup_user((const void __user *)(unsigned long)batBatch.lpCommands, batBatch.iCount * sizeof(struct interrupt_demo_command)); //Copied before taking the lock, copy_from_user() may sleep
+    if (IS_ERR(lpCommands)) {
+        return PTR_ERR(lpCommands);
+    }
+    long iResult = 0;
+    unsigned int i;
+    for (i = 0; i < batBatch.iCount; ++i) {
+        if (!IsIoControlCommandValid(lpCommands[i].iCommand, lpCommands[i].iArgument)) {
+            WRNPRINT("Invalid command %u with argument %u at %u of batch, nothing is applied.\n", lpCommands[i].iCommand, lpCommands[i].iArgument, i);
+            iResult = -EINVAL;
+            goto out_free;
+        }
+    }
+    DBGPRINT("Applying a batch of %u IOControl commands.\n", batBatch.iCount);
+#ifdef IS_IOCTL_OPERATION_MUTEX_REQUESTED
+    mutex_lock(&mtxIoCtlLock); //One lock round-trip for the whole batch
+#endif
+    for (i = 0; i < batBatch.iCount; ++i) {
+        if (-ENOTTY == ProcessReaderCommand(lpReader, lpCommands[i].iCommand, lpCommands[i].iArgument)) {
+            ProcessIoControlCommand(lpCommands[i].iCommand, lpCommands[i].iArgument);
+        }
+    }
+    iResult = PublishSettings();
+#ifdef IS_IOCTL_OPERATION_MUTEX_REQUESTED
+    mutex_unlock(&mtxIoCtlLock); //Don't forget to unlock me!
 #endif
+out_free:
+    kfree(lpCommands);
     return iResult;
 }
 
+/*
+ * GetIoControlConfig() Function
+ *
+ * This function copies the current configuration to user RAM space, for CTL_IOC_GET_CONFIG.
+ *
+ */
+static long GetIoControlConfig(struct interrupt_demo_config __user * lpConfig) {
+    struct interrupt_demo_config cfgConfig;
+    memset(&cfgConfig, 0, sizeof(cfgConfig));
+#ifdef IS_IOCTL_OPERATION_MUTEX_REQUESTED
+    mutex_lock(&mtxIoCtlLock); //Take a consistent snapshot
+#endif
+    cfgConfig.iChannelCount = iDataChannelCount;
+    cfgConfig.iChannel = iCurrentChannel;
+    cfgConfig.iChannelLayout = iChannelLayout;
+    memcpy(cfgConfig.arrGains, setPendingSettings.arrChannelGains, sizeof(cfgConfig.arrGains));
+    cfgConfig.iDelay = setPendingSettings.iDelay;
+    cfgConfig.iCompressCount = setPendingSettings.iCompressCount;
+    cfgConfig.iCompressStep = setPendingSettings.iCompressStep;
+    cfgConfig.iCompressMode = setPendingSettings.iCompressMode;
+    cfgConfig.iOverflowMode = arrDataRings[0].lpControl->iOverflowMode;
+    cfgConfig.iSampleFormat = setPendingSettings.iSampleFormat;
+    cfgConfig.iReadMode = iReadMode;
+    cfgConfig.iTemplate = setPendingSettings.iTemplate;
+    cfgConfig.iPulseMode = setPendingSettings.iPulseMode;
+    cfgConfig.iPulseBaseline = setPendingSettings.iPulseBaseline;
+    cfgConfig.iPulseThreshold = setPendingSettings.iPulseThreshold;
+    cfgConfig.iTriggerMode = setPendingSettings.iTriggerMode;
+    cfgConfig.iTriggerLevel = setPendingSettings.iTriggerLevel;
+    cfgConfig.iTriggerChannel = setPendingSettings.iTriggerChannel;
+    cfgConfig.iTriggerPreFrames = setPendingSettings.iTriggerPreFrames;
+    cfgConfig.iTriggerPostFrames = setPendingSettings.iTriggerPostFrames;
+    cfgConfig.iTriggerHoldoff = setPendingSettings.iTriggerHoldoff;
+#ifdef IS_IOCTL_OPERATION_MUTEX_REQUESTED
+    mutex_unlock(&mtxIoCtlLock); //Don't forget to unlock me!
+#endif
+    return copy_to_user(lpConfig, &cfgConfig, sizeof(cfgConfig)) ? -EFAULT : 0;
+}
+
 /* 
  * interrupt_demo_unlocked_ioctl() Function
  * 
  * This function processes IO control commands and parameters.
+ * Typed requests (see header file) carry a pointer to their argument, raw CTL_CMD_* commands carry the argument itself.
  * 
  */
 static long interrupt_demo_unlocked_ioctl(struct file * lpFile, unsigned int iIoControlCommand, unsigned long lpIoControlParameters) {
     DBGPRINT("Unlocked IOControl command %u with argument %lu received.\n", iIoControlCommand, lpIoControlParameters);
-#ifdef IS_IOCTL_OPERATION_SPINLOCK_REQUESTED
-    spin_lock(&spnlkIoCtlLock); //Locks IoCtl operations
+    long iResult;
+    if (CTL_IOC_BATCH == iIoControlCommand) {
+        return ProcessIoControlBatch(lpFile->private_data, (const struct interrupt_demo_command_batch __user *)lpIoControlParameters);
+    }
+    if (CTL_IOC_GET_READER_STATS == iIoControlCommand) {
+        return GetReaderStats(lpFile->private_data, (struct interrupt_demo_reader_stats __user *)lpIoControlParameters);
+    }
+    if (CTL_IOC_GET_CONFIG == iIoControlCommand) {
+        return GetIoControlConfig((struct interrupt_demo_config __user *)lpIoControlParameters);
+    }
+    if (CTL_IOC_LOAD_TEMPLATE == iIoControlCommand) {
+        return LoadWaveformTemplate((const struct interrupt_demo_template_load __user *)lpIoControlParameters);
+    }
+    if (CTL_IOC_MAGIC == _IOC_TYPE(iIoControlCommand)) {
+        unsigned int iArgument;
+        if (iIoControlCommand != CTL_IOC(_IOC_NR(iIoControlCommand))) {
+            return -ENOTTY;
+        }
+        if (get_user(iArgument, (unsigned int __user *)lpIoControlParameters)) {
+            return -EFAULT;
+        }
+        iIoControlCommand = _IOC_NR(iIoControlCommand);
+        lpIoControlParameters = iArgument;
+        if (!IsIoControlCommandValid(iIoControlCommand, lpIoControlParameters)) {
+            return -EINVAL;
+        }
+    }
+#ifdef IS_IOCTL_OPERATION_MUTEX_REQUESTED
+    mutex_lock(&mtxIoCtlLock); //Locks IoCtl operations
 #endif
-    ProcessIoControlCommand(iIoControlCommand, lpIoControlParameters);
-#ifdef IS_IOCTL_OPERATION_SPINLOCK_REQUESTED
-    spin_unlock(&spnlkIoCtlLock); //Don't forget to unlock me!
+    iResult = ProcessReaderCommand(lpFile->private_data, iIoControlCommand, lpIoControlParameters);
+    if (-ENOTTY == iResult) {
+        iResult = ProcessIoControlCommand(iIoControlCommand, lpIoControlParameters);
+        if (0 == iResult) {
+            iResult = PublishSettings();
+        }
+    }
+#ifdef IS_IOCTL_OPERATION_MUTEX_REQUESTED
+    mutex_unlock(&mtxIoCtlLock); //Don't forget to unlock me!
 #endif
-    return 0;
+    return iResult;
 }
 
 /*
@@ -171,12 +2078,13 @@ static long interrupt_demo_unlocked_ioctl(struct file * lpFile, unsigned int iIo
  * 
 static long interrupt_demo_compact_ioctl(struct file * lpFile, unsigned int iIoControlCommand, unsigned long lpIoControlParameters){  
     DBGPRINT("Unlocked IOControl command %u with argument %lu received.\n", iIoControlCommand, lpIoControlParameters);
-#ifdef IS_IOCTL_OPERATION_SPINLOCK_REQUESTED
-    spin_lock(&spnlkIoCtlLock); //Locks IoCtl operations
+#ifdef IS_IOCTL_OPERATION_MUTEX_REQUESTED
+    mutex_lock(&mtxIoCtlLock); //Locks IoCtl operations
 #endif
     ProcessIoControlCommand(iIoControlCommand, lpIoControlParameters);
-#ifdef IS_IOCTL_OPERATION_SPINLOCK_REQUESTED
-    spin_unlock(&spnlkIoCtlLock); //Don't forget to unlock me!
+    PublishSettings();
+#ifdef IS_IOCTL_OPERATION_MUTEX_REQUESTED
+    mutex_unlock(&mtxIoCtlLock); //Don't forget to unlock me!
 #endif
     return 0;
 }
@@ -189,12 +2097,13 @@ static long interrupt_demo_compact_ioctl(struct file * lpFile, unsigned int iIoC
  * 
 static int interrupt_demo_ioctl(struct inode * lpNode, struct file *file, unsigned int iIoControlCommand, unsigned long lpIoControlParameters){  
     DBGPRINT("IOControl command %u with argument %lu received.\n", iIoControlCommand, lpIoControlParameters);
-#ifdef IS_IOCTL_OPERATION_SPINLOCK_REQUESTED
-    spin_lock(&spnlkIoCtlLock); //Locks IoCtl operations
+#ifdef IS_IOCTL_OPERATION_MUTEX_REQUESTED
+    mutex_lock(&mtxIoCtlLock); //Locks IoCtl operations
 #endif
     ProcessIoControlCommand(iIoControlCommand, lpIoControlParameters);
-#ifdef IS_IOCTL_OPERATION_SPINLOCK_REQUESTED
-    spin_unlock(&spnlkIoCtlLock); //Don't forget to unlock me!
+    PublishSettings();
+#ifdef IS_IOCTL_OPERATION_MUTEX_REQUESTED
+    mutex_unlock(&mtxIoCtlLock); //Don't forget to unlock me!
 #endif
     return 0;
 }
@@ -208,71 +2117,713 @@ static struct file_operations interrupt_demo_device_file_operations = {
     .read = interrupt_demo_read, //Read operations, executed when calling read()
     .write = interrupt_demo_write, //Write operations, executed when calling write()
     .unlocked_ioctl = interrupt_demo_unlocked_ioctl, //Unlocked IOControl, executed when calling ioctl()
+    .poll = interrupt_demo_poll, //Readiness of Frame Ring, executed when calling poll(), select() or epoll_wait()
+    .mmap = interrupt_demo_mmap, //Memory mapping of Frame Ring, executed when calling mmap()
+    .splice_read = interrupt_demo_splice_read, //Frame records into a pipe, executed when calling splice() or sendfile()
     //.compact_ioctl = interrupt_demo_compact_ioctl, //Compact IOControl, executed when calling ioctl() from 32-bit user application on 64-bit platform
     //.ioctl = interrupt_demo_ioctl, //For kernels before 2.6.36, use .ioctl and comment .unlocked_ioctl
 };
 
+/* IRQ Event FIFO Related Functions */
+/*
+ * QueueIrqEvent() Function
+ *
+ * This function queues a record of an interrupt of lpLine into IRQ Event FIFO, then wakes up its consumers if any is waiting.
+ * It takes no lock and never prints, so its cost is fixed in any interrupt handler. If the FIFO is full, the record is dropped.
+ *
+ */
+static void QueueIrqEvent(const struct interrupt_demo_irq_line * lpLine) {
+    struct interrupt_demo_irq_event_fifo * lpFifo = &fifIrqEvents;
+    u64 lTimestamp = ktime_to_ns(ktime_get());
+    unsigned int iHead;
+    do {
+        iHead = ACCESS_ONCE(lpFifo->iHead);
+        if (iHead - ACCESS_ONCE(lpFifo->iTail) >= IRQ_EVENT_FIFO_DEPTH) { //Full, drop this record
+            atomic_inc(&lpFifo->iDropped);
+            return;
+        }
+    } while (cmpxchg(&lpFifo->iHead, iHead, iHead + 1) != iHead); //Another handler has reserved this slot, try the next one
+    struct interrupt_demo_irq_event_slot * lpSlot = &lpFifo->arrSlots[iHead & (IRQ_EVENT_FIFO_DEPTH - 1)];
+    lpSlot->evtEvent.iLine = lpLine->iArgument;
+    lpSlot->evtEvent.iSequence = lpLine->lEvents - 1; //DispatchIrq() has counted this interrupt
+    lpSlot->evtEvent.lTimestamp = lTimestamp;
+    smp_wmb(); //Record must be visible before it's committed
+    ACCESS_ONCE(lpSlot->iCommit) = iHead + 1;
+    smp_mb(); //Commit must be visible before checking for waiters, pairs with the barrier in prepare_to_wait()
+    if (waitqueue_active(&wqIrqEventReadQueue)) {
+        wake_up_interruptible(&wqIrqEventReadQueue);
+    }
+}
+
+//Returns true if the oldest record of IRQ Event FIFO is committed
+static inline bool IsIrqEventReadable(void) {
+    unsigned int iTail = ACCESS_ONCE(fifIrqEvents.iTail);
+    return ACCESS_ONCE(fifIrqEvents.arrSlots[iTail & (IRQ_EVENT_FIFO_DEPTH - 1)].iCommit) == iTail + 1;
+}
+
+/*
+ * interrupt_demo_events_read() Function
+ *
+ * This function copies as many committed records of IRQ Event FIFO as fit to user RAM space, oldest first, then releases them.
+ * Returns the number of Bytes copied. See header file for blocking and errors.
+ *
+ */
+static ssize_t interrupt_demo_events_read(struct file * lpFile, char __user * lpszBuffer, size_t iSize, loff_t * lpOffset) {
+    struct interrupt_demo_irq_event_fifo * lpFifo = &fifIrqEvents;
+    if (iSize < sizeof(struct interrupt_demo_irq_event)) {
+        return -EINVAL;
+    }
+    if (mutex_lock_interruptible(&mtxIrqEventReadLock)) {
+        return -ERESTARTSYS;
+    }
+    while (!IsIrqEventReadable()) {
+        mutex_unlock(&mtxIrqEventReadLock);
+        if (lpFile->f_flags & O_NONBLOCK) {
+            return -EAGAIN;
+        }
+        if (wait_event_interruptible(wqIrqEventReadQueue, IsIrqEventReadable())) {
+            return -ERESTARTSYS; //Interrupted by a signal
+        }
+        if (mutex_lock_interruptible(&mtxIrqEventReadLock)) {
+            return -ERESTARTSYS;
+        }
+    }
+    unsigned int iTail = lpFifo->iTail;
+    ssize_t iResult = 0;
+    while (iSize - iResult >= sizeof(struct interrupt_demo_irq_event)) {
+        struct interrupt_demo_irq_event_slot * lpSlot = &lpFifo->arrSlots[iTail & (IRQ_EVENT_FIFO_DEPTH - 1)];
+        if (ACCESS_ONCE(lpSlot->iCommit) != iTail + 1) { //Not committed yet
+            break;
+        }
+        smp_rmb(); //Read the commit before the record
+        if (copy_to_user(lpszBuffer + iResult, &lpSlot->evtEvent, sizeof(struct interrupt_demo_irq_event))) {
+            iResult = iResult ? iResult : -EFAULT;
+            break;
+        }
+        iResult += sizeof(struct interrupt_demo_irq_event);
+        ++iTail;
+    }
+    smp_mb(); //Finish reading records before releasing their slots
+    ACCESS_ONCE(lpFifo->iTail) = iTail;
+    mutex_unlock(&mtxIrqEventReadLock);
+    return iResult;
+}
+
+//Reports IRQ Event FIFO as readable when its oldest record is committed, for poll(), select() and epoll
+static unsigned int interrupt_demo_events_poll(struct file * lpFile, poll_table * lpPollTable) {
+    poll_wait(lpFile, &wqIrqEventReadQueue, lpPollTable);
+    return IsIrqEventReadable() ? POLLIN | POLLRDNORM : 0;
+}
+
+/* Pointers to IRQ Event FIFO Related Functions */
+static struct file_operations interrupt_demo_events_file_operations = {
+    .owner = THIS_MODULE,
+    .open = nonseekable_open, //Open device, executed when calling open()
+    .read = interrupt_demo_events_read, //Read records, executed when calling read()
+    .poll = interrupt_demo_events_poll, //Readiness of IRQ Event FIFO, executed when calling poll(), select() or epoll_wait()
+};
+
+/* Playback Related Functions */
+//Returns the number of blocks queued in Playback Ring. A user space producer may write any iHead, so it's clamped to the depth
+static inline unsigned int GetQueuedBlocks(const struct interrupt_demo_playback * lpPlayback) {
+    return GetMin(ACCESS_ONCE(lpPlayback->lpControl->iHead) - ACCESS_ONCE(lpPlayback->lpControl->iTail), lpPlayback->iDepth);
+}
+
+//Returns true if Playback Ring has drained to the low watermark, writers are woken up from here
+static inline bool IsPlaybackWritable(const struct interrupt_demo_playback * lpPlayback) {
+    return GetQueuedBlocks(lpPlayback) <= ACCESS_ONCE(lpPlayback->lpControl->iLowWatermark);
+}
+
+//Copies the oldest block of Playback Ring into a half of the double buffer and releases its slot, returns false if the ring is empty. Called by DAC_INT only
+static bool PrefillPlaybackBuffer(struct interrupt_demo_playback * lpPlayback, unsigned int iBuffer) {
+    struct interrupt_demo_playback_control * lpControl = lpPlayback->lpControl;
+    unsigned int iTail = lpControl->iTail;
+    if (ACCESS_ONCE(lpControl->iHead) == iTail) {
+        return false;
+    }
+    smp_rmb(); //Read iHead before the block
+    memcpy(lpPlayback->arrBuffers[iBuffer], lpPlayback->lpBlocks[iTail & (lpPlayback->iDepth - 1)], sizeof(lpPlayback->arrBuffers[iBuffer]));
+    smp_mb(); //Finish reading the block before releasing its slot
+    ACCESS_ONCE(lpControl->iTail) = iTail + 1;
+    return true;
+}
+
+/*
+ * PlayNextBlock() Function
+ *
+ * This function is called by every DAC_INT, when the converter has finished the active half of the double buffer.
+ * It hands the converter the other half first, which the previous DAC_INT has pre-filled, then pre-fills the half just finished with the next block of Playback Ring.
+ * If no block was pre-filled, the ring gets one more chance (a late writer), then the converter holds the last sample played, which is counted as an underrun while a writer is attached.
+ *
+ */
+static void PlayNextBlock(struct interrupt_demo_playback * lpPlayback) {
+    struct interrupt_demo_playback_control * lpControl = lpPlayback->lpControl;
+    unsigned int iNext = lpPlayback->iActiveBuffer ^ 1;
+    if (lpPlayback->bIsPrefilled || PrefillPlaybackBuffer(lpPlayback, iNext)) {
+        lpPlayback->iActiveBuffer = iNext;
+        lpPlayback->bIsHolding = false;
+        ++lpPlayback->lPlayedBlocks;
+    }
+    else {
+        if (atomic_read(&lpPlayback->iWriters) && lpPlayback->lPlayedBlocks != ACCESS_ONCE(lpPlayback->lOpenPlayedBlocks)) {
+            ACCESS_ONCE(lpControl->iUnderruns) = lpControl->iUnderruns + 1;
+        }
+        if (!lpPlayback->bIsHolding) { //A step to 0 would be a glitch, hold the last sample instead. Once held, the same half is played again
+            unsigned int iLastSample = lpPlayback->arrBuffers[lpPlayback->iActiveBuffer][PLAYBACK_BLOCK_SAMPLES - 1];
+            unsigned int iIndex;
+            for (iIndex = 0; iIndex < PLAYBACK_BLOCK_SAMPLES; ++iIndex) {
+                lpPlayback->arrBuffers[iNext][iIndex] = iLastSample;
+            }
+            lpPlayback->iActiveBuffer = iNext;
+            lpPlayback->bIsHolding = true;
+        }
+    }
+    ACCESS_ONCE(lpPlayback->lpDacBlock) = lpPlayback->arrBuffers[lpPlayback->iActiveBuffer]; //Hand the block to the converter
+    lpPlayback->bIsPrefilled = PrefillPlaybackBuffer(lpPlayback, lpPlayback->iActiveBuffer ^ 1);
+    smp_mb(); //iTail must be visible before checking for waiters, pairs with the barrier in prepare_to_wait()
+    if (IsPlaybackWritable(lpPlayback) && waitqueue_active(&wqPlaybackWriteQueue)) {
+        wake_up_interruptible(&wqPlaybackWriteQueue);
+    }
+}
+
+//Only one file may write Playback Ring at a time, files opened read-only may read statistics or map it
+static int interrupt_demo_playback_open(struct inode * lpNode, struct file * lpFile) {
+    if (lpFile->f_mode & FMODE_WRITE) {
+        if (atomic_cmpxchg(&plbPlayback.iWriters, 0, 1)) {
+            return -EBUSY;
+        }
+        ACCESS_ONCE(plbPlayback.lOpenPlayedBlocks) = ACCESS_ONCE(plbPlayback.lPlayedBlocks);
+    }
+    return nonseekable_open(lpNode, lpFile);
+}
+
+//Blocks already queued keep playing after the writer has closed the device, running dry then is not an underrun
+static int interrupt_demo_playback_release(struct inode * lpNode, struct file * lpFile) {
+    if (lpFile->f_mode & FMODE_WRITE) {
+        atomic_set(&plbPlayback.iWriters, 0);
+    }
+    return 0;
+}
+
+/*
+ * interrupt_demo_playback_write() Function
+ *
+ * This function copies as many whole blocks as fit in Playback Ring from user RAM space, then queues them.
+ * Returns the number of Bytes queued. See header file for blocking and errors.
+ *
+ */
+static ssize_t interrupt_demo_playback_write(struct file * lpFile, const char __user * lpszBuffer, size_t iSize, loff_t * lpOffset) {
+    struct interrupt_demo_playback * lpPlayback = &plbPlayback;
+    struct interrupt_demo_playback_control * lpControl = lpPlayback->lpControl;
+    if (iSize < sizeof(lpPlayback->lpBlocks[0])) {
+        return -EINVAL;
+    }
+    if (mutex_lock_interruptible(&mtxPlaybackWriteLock)) {
+        return -ERESTARTSYS;
+    }
+    while (GetQueuedBlocks(lpPlayback) >= lpPlayback->iDepth) {
+        mutex_unlock(&mtxPlaybackWriteLock);
+        if (lpFile->f_flags & O_NONBLOCK) {
+            return -EAGAIN;
+        }
+        if (wait_event_interruptible(wqPlaybackWriteQueue, IsPlaybackWritable(lpPlayback))) {
+            return -ERESTARTSYS; //Interrupted by a signal
+        }
+        if (mutex_lock_interruptible(&mtxPlaybackWriteLock)) {
+            return -ERESTARTSYS;
+        }
+    }
+    unsigned int iHead = lpControl->iHead;
+    ssize_t iResult = 0;
+    while (iSize - iResult >= sizeof(lpPlayback->lpBlocks[0]) && iHead - ACCESS_ONCE(lpControl->iTail) < lpPlayback->iDepth) {
+        smp_mb(); //Read iTail before overwriting the slot it has released, pairs with the barrier in PrefillPlaybackBuffer()
+        if (copy_from_user(lpPlayback->lpBlocks[iHead & (lpPlayback->iDepth - 1)], lpszBuffer + iResult, sizeof(lpPlayback->lpBlocks[0]))) {
+            iResult = iResult ? iResult : -EFAULT;
+            break;
+        }
+        iResult += sizeof(lpPlayback->lpBlocks[0]);
+        ++iHead;
+    }
+    smp_wmb(); //Blocks must be visible before they're queued
+    ACCESS_ONCE(lpControl->iHead) = iHead;
+    mutex_unlock(&mtxPlaybackWriteLock);
+    return iResult;
+}
+
+//Reports Playback Ring as writable when it has drained to the low watermark, for poll(), select() and epoll
+static unsigned int interrupt_demo_playback_poll(struct file * lpFile, poll_table * lpPollTable) {
+    poll_wait(lpFile, &wqPlaybackWriteQueue, lpPollTable);
+    return IsPlaybackWritable(&plbPlayback) ? POLLOUT | POLLWRNORM : 0;
+}
+
+//Maps Control Page and all blocks of Playback Ring to user RAM space, so blocks can be filled in place without write(). See header file for the layout and the producing protocol
+static int interrupt_demo_playback_mmap(struct file * lpFile, struct vm_area_struct * lpVma) {
+    DBGPRINT("Mapping %lu Bytes of Playback Ring to user RAM space...\n", lpVma->vm_end - lpVma->vm_start);
+    if (lpVma->vm_pgoff != 0 || lpVma->vm_end - lpVma->vm_start > plbPlayback.lMapSize) {
+        WRNPRINT("Invalid mapping of %lu Bytes at page offset %lu.\n", lpVma->vm_end - lpVma->vm_start, lpVma->vm_pgoff);
+        return -EINVAL;
+    }
+    return remap_vmalloc_range(lpVma, plbPlayback.lpControl, 0);
+}
+
+//Sets the low watermark of Playback Ring, called by CTL_CMD_SET_PLAYBACK_WATERMARK on either device
+static long SetPlaybackWatermark(unsigned long lWatermark) {
+    if (lWatermark >= plbPlayback.iDepth) {
+        WRNPRINT("Invalid playback watermark %lu, Playback Ring has %u blocks.\n", lWatermark, plbPlayback.iDepth);
+        return -EINVAL;
+    }
+    DBGPRINT("Setting playback watermark to %lu blocks.\n", lWatermark);
+    ACCESS_ONCE(plbPlayback.lpControl->iLowWatermark) = lWatermark;
+    wake_up_interruptible(&wqPlaybackWriteQueue); //Readiness depends on the watermark
+    return 0;
+}
+
+//Copies the state of Playback Ring to user RAM space, for CTL_IOC_GET_PLAYBACK_STATS
+static long GetPlaybackStats(struct interrupt_demo_playback_stats __user * lpStats) {
+    struct interrupt_demo_playback_stats plsStats;
+    memset(&plsStats, 0, sizeof(plsStats));
+    plsStats.lPlayedBlocks = ACCESS_ONCE(plbPlayback.lPlayedBlocks);
+    plsStats.iUnderruns = ACCESS_ONCE(plbPlayback.lpControl->iUnderruns);
+    plsStats.iQueuedBlocks = GetQueuedBlocks(&plbPlayback);
+    plsStats.iLowWatermark = ACCESS_ONCE(plbPlayback.lpControl->iLowWatermark);
+    return copy_to_user(lpStats, &plsStats, sizeof(plsStats)) ? -EFAULT : 0;
+}
+
+//Processes IO control requests of Playback Ring, settings of the acquisition are only accepted by the first device
+static long interrupt_demo_playback_ioctl(struct file * lpFile, unsigned int iIoControlCommand, unsigned long lpIoControlParameters) {
+    unsigned int iArgument;
+    if (CTL_IOC_GET_PLAYBACK_STATS == iIoControlCommand) {
+        return GetPlaybackStats((struct interrupt_demo_playback_stats __user *)lpIoControlParameters);
+    }
+    if (CTL_IOC(CTL_CMD_SET_PLAYBACK_WATERMARK) == iIoControlCommand) {
+        if (get_user(iArgument, (unsigned int __user *)lpIoControlParameters)) {
+            return -EFAULT;
+        }
+        return SetPlaybackWatermark(iArgument);
+    }
+    return -ENOTTY;
+}
+
+/* Pointers to Playback Related Functions */
+static struct file_operations interrupt_demo_playback_file_operations = {
+    .owner = THIS_MODULE,
+    .open = interrupt_demo_playback_open, //Open device, executed when calling open()
+    .release = interrupt_demo_playback_release, //Release device, executed when calling close()
+    .write = interrupt_demo_playback_write, //Queue blocks, executed when calling write()
+    .unlocked_ioctl = interrupt_demo_playback_ioctl, //Unlocked IOControl, executed when calling ioctl()
+    .poll = interrupt_demo_playback_poll, //Readiness of Playback Ring, executed when calling poll(), select() or epoll_wait()
+    .mmap = interrupt_demo_playback_mmap, //Memory mapping of Playback Ring, executed when calling mmap()
+};
+
 /* Interrupt Handlers */
-//Interrupt handler of S_INT
+//Bottom half of S_INT, runs in the IRQ thread, in the workqueue, or right after the top half, according to iSIntBottomHalfMode
+static irqreturn_t s_int_thread(int iIrq, void * lpDevId) {
+#ifdef IS_DATA_BUFFER_SPINLOCK_REQUESTED
+    spin_lock(&spnlkDataBufferLock); //Begin producing, serializes with software-triggered S_INT
+#endif
+    ProcessSIntEvents(&queSIntEventQueue);
+#ifdef IS_DATA_BUFFER_SPINLOCK_REQUESTED
+    spin_unlock(&spnlkDataBufferLock); //Don't forget to unlock me!
+#endif
+    return IRQ_HANDLED;
+}
+static void s_int_work(struct work_struct * lpWork) {
+    s_int_thread(S_INT, NULL);
+}
+//Interrupt handler (top half) of S_INT
 static irqreturn_t s_int_interrupt(int iIrq, void * lpDevId) {
     //DBGPRINT("Interrupt Handler: Interrupt %s, handler %s, at line %d.\n", S_INT_NAME, __FUNCTION__, __LINE__);
-    disable_irq_nosync(S_INT); //Use disable_irq_nosync() in Interrupt Handlers. Use disable_irq() in normal functions
-    //Sample data generation code
-#ifdef IS_DATA_BUFFER_SPINLOCK_REQUESTED
-    write_lock(&rwlkDataBufferLock); //Begin writing, locks arrDataBuffer
+    irqreturn_t iResult;
+#ifdef IS_IRQ_STATISTICS_REQUESTED
+    u64 lArrival = StatsIrqEnter(STATS_IRQ_S_INT);
 #endif
-    int i;
-    for (i = 0; i < DATA_BUFFER_WAVE_DATA_SIZE; ++i) {
-        arrDataBuffer[i] = arrDataDef[i] + random32() % DATA_MAX_VALUE;
+    spin_lock(&spnlkSIntEventLock); //Serialize with software-triggered S_INT
+    QueueSIntEvent(&queSIntEventQueue);
+    spin_unlock(&spnlkSIntEventLock); //Don't forget to unlock me!
+    switch (iSIntBottomHalfMode) {
+    case S_INT_BOTTOM_HALF_THREADED_IRQ:
+        iResult = IRQ_WAKE_THREAD; //s_int_thread() will be called in the IRQ thread
+        break;
+    case S_INT_BOTTOM_HALF_WORKQUEUE:
+        if (S_INT_CPU_ANY != iSIntCpu) {
+            queue_work_on(iSIntCpu, lpSIntWorkqueue, &wkSIntBottomHalf);
+        }
+        else {
+            queue_work(lpSIntWorkqueue, &wkSIntBottomHalf);
+        }
+        iResult = IRQ_HANDLED;
+        break;
+    default:
+        iResult = s_int_thread(iIrq, lpDevId);
+        break;
     }
-#ifdef IS_DATA_BUFFER_SPINLOCK_REQUESTED
-    write_unlock(&rwlkDataBufferLock); //Don't forget to unlock me!
+#ifdef IS_IRQ_STATISTICS_REQUESTED
+    StatsIrqExit(STATS_IRQ_S_INT, lArrival);
 #endif
-    enable_irq(S_INT); //enable_irq() before returning
-    return IRQ_HANDLED;
+    return iResult;
 }
-//Interrupt handler of DP_INT
+//Interrupt handler of DP_INT, it takes the snapshot of Frame Ring heads readers aligned to DP_INT are woken up by
 static irqreturn_t dp_int_interrupt(int iIrq, void * lpDevId) {
     //DBGPRINT("Interrupt Handler: Interrupt %s, handler %s, at line %d.\n", XEINT20_NAME, __FUNCTION__, __LINE__);
+#ifdef IS_IRQ_STATISTICS_REQUESTED
+    u64 lArrival = StatsIrqEnter(STATS_IRQ_DP_INT);
+#endif
+    unsigned int iChannel;
+    write_seqcount_begin(&scDpIntTick);
+    for (iChannel = 0; iChannel < iDataChannelCount; ++iChannel) {
+        arrDpIntHeads[iChannel] = ACCESS_ONCE(arrDataRings[iChannel].lpControl->iHead);
+    }
+    lDpIntTimestamp = ktime_to_ns(ktime_get());
+    write_seqcount_end(&scDpIntTick);
+    if (atomic_read(&iAlignedReaders)) {
+        wake_up_interruptible(&wqDataRingReadQueue);
+    }
+#ifdef IS_IRQ_STATISTICS_REQUESTED
+    StatsIrqExit(STATS_IRQ_DP_INT, lArrival);
+#endif
     return IRQ_HANDLED;
 }
-//Interrupt handler of PW_INT
+//Interrupt handler of PW_INT, it queues a record into IRQ Event FIFO
 static irqreturn_t pw_int_interrupt(int iIrq, void * lpDevId) {
     //DBGPRINT("Interrupt Handler: Interrupt %s, handler %s, at line %d.\n", PW_INT_NAME, __FUNCTION__, __LINE__);
+#ifdef IS_IRQ_STATISTICS_REQUESTED
+    u64 lArrival = StatsIrqEnter(STATS_IRQ_PW_INT);
+#endif
+    QueueIrqEvent(lpDevId);
+#ifdef IS_IRQ_STATISTICS_REQUESTED
+    StatsIrqExit(STATS_IRQ_PW_INT, lArrival);
+#endif
     return IRQ_HANDLED;
 }
-//Interrupt handler of DAC_INT
+//Interrupt handler of DAC_INT, it plays the next block of Playback Ring, then queues a record into IRQ Event FIFO
 static irqreturn_t dac_int_interrupt(int iIrq, void * lpDevId) {
     //DBGPRINT("Interrupt Handler: Interrupt %s, handler %s, at line %d.\n", DAC_INT_NAME, __FUNCTION__, __LINE__);
+#ifdef IS_IRQ_STATISTICS_REQUESTED
+    u64 lArrival = StatsIrqEnter(STATS_IRQ_DAC_INT);
+#endif
+    PlayNextBlock(&plbPlayback); //The converter is waiting, this goes first
+    QueueIrqEvent(lpDevId);
+#ifdef IS_IRQ_STATISTICS_REQUESTED
+    StatsIrqExit(STATS_IRQ_DAC_INT, lArrival);
+#endif
     return IRQ_HANDLED;
 }
 
 #ifdef IS_GPIO_INTERRUPT_DEBUG
-//Interrupt handler of KEY_HOME
-static irqreturn_t key_home_interrupt(int iIrq, void * lpDevId) {
-    DBGPRINT("Interrupt Handler: Interrupt %s, handler %s, at line %d.\n", KEY_HOME_NAME, __FUNCTION__, __LINE__);
+//Interrupt handler of all GPIO keys, it queues a record into IRQ Event FIFO. The record tells which key it is
+static irqreturn_t key_interrupt(int iIrq, void * lpDevId) {
+    QueueIrqEvent(lpDevId);
     return IRQ_HANDLED;
 }
-//Interrupt handler of KEY_BACK
-static irqreturn_t key_back_interrupt(int iIrq, void * lpDevId) {
-    DBGPRINT("Interrupt Handler: Interrupt %s, handler %s, at line %d.\n", KEY_BACK_NAME, __FUNCTION__, __LINE__);
-    return IRQ_HANDLED;
+#endif
+
+/* Interrupt Source Related Functions */
+#ifdef IS_SIMULATED_INTERRUPT_SOURCE
+//Timer callback of a simulated interrupt, runs in hard IRQ context like a real interrupt handler
+static enum hrtimer_restart SimulatedIrqTimerCallback(struct hrtimer * lpTimer) {
+    struct interrupt_demo_simulated_irq * lpIrq = container_of(lpTimer, struct interrupt_demo_simulated_irq, hrtTimer);
+    hrtimer_forward_now(lpTimer, lpIrq->ktPeriod); //Missed periods are merged into this one, like edges of a masked GPIO interrupt
+    if (0 == atomic_read(&lpIrq->iDisableDepth)) {
+        if (IRQ_WAKE_THREAD == lpIrq->lpHandler(lpIrq - arrSimulatedIrqs, lpIrq->lpDevId) && lpIrq->lpThread) {
+            set_bit(0, &lpIrq->lThreadFlags);
+            wake_up_process(lpIrq->lpThread);
+        }
+    }
+    return HRTIMER_RESTART;
 }
-//Interrupt handler of KEY_SLEEP/GYRO_INT, Interrupt ID XEINT27, Label EXYNOS4_GPX3(3)
-static irqreturn_t key_sleep_interrupt(int iIrq, void * lpDevId) {
-    DBGPRINT("Interrupt Handler: Interrupt %s, handler %s, at line %d.\n", KEY_SLEEP_NAME, __FUNCTION__, __LINE__);
-    return IRQ_HANDLED;
+
+//Thread of a simulated threaded interrupt, runs lpThreadFunction each time the handler returns IRQ_WAKE_THREAD
+static int SimulatedIrqThread(void * lpData) {
+    struct interrupt_demo_simulated_irq * lpIrq = lpData;
+    for (;;) {
+        set_current_state(TASK_INTERRUPTIBLE);
+        if (test_and_clear_bit(0, &lpIrq->lThreadFlags)) {
+            __set_current_state(TASK_RUNNING);
+            lpIrq->lpThreadFunction(lpIrq - arrSimulatedIrqs, lpIrq->lpDevId);
+            continue;
+        }
+        if (kthread_should_stop()) {
+            break;
+        }
+        schedule();
+    }
+    __set_current_state(TASK_RUNNING);
+    return 0;
 }
-//Interrupt handler of KEY_VOL+/KP_ROW1, Interrupt ID XEINT17, Label EXYNOS4_GPX2(1)
-static irqreturn_t key_volup_interrupt(int iIrq, void * lpDevId) {
-    DBGPRINT("Interrupt Handler: Interrupt %s, handler %s, at line %d.\n", KEY_VOLUP_NAME, __FUNCTION__, __LINE__);
-    return IRQ_HANDLED;
+
+//Starts the timer of a simulated interrupt on the CPU this runs on, called on iCpu by smp_call_function_single()
+static void StartPinnedSimulatedIrq(void * lpData) {
+    struct interrupt_demo_simulated_irq * lpIrq = lpData;
+    hrtimer_start(&lpIrq->hrtTimer, lpIrq->ktPeriod, HRTIMER_MODE_REL_PINNED);
 }
-//Interrupt handler of KEY_VOL-
-static irqreturn_t key_voldown_interrupt(int iIrq, void * lpDevId) {
-    DBGPRINT("Interrupt Handler: Interrupt %s, handler %s, at line %d.\n", KEY_VOLDOWN_NAME, __FUNCTION__, __LINE__);
-    return IRQ_HANDLED;
+
+/*
+ * RequestSimulatedIrq() Function
+ *
+ * This function starts generating interrupt iIrq at arrSimulatedIrqRates[iIrq] Hz, calling lpHandler (and lpThreadFunction if not NULL) with lpDevId each time.
+ * If iCpu isn't S_INT_CPU_ANY, the handler and the thread function always run on that CPU.
+ * Returns 0 on success (including a rate of 0, which leaves the interrupt off), or a negative error code.
+ *
+ */
+static int RequestSimulatedIrq(unsigned int iIrq, irq_handler_t lpHandler, irq_handler_t lpThreadFunction, const char * lpszName, int iCpu, void * lpDevId) {
+    struct interrupt_demo_simulated_irq * lpIrq = &arrSimulatedIrqs[iIrq];
+    int iRate = arrSimulatedIrqRates[iIrq];
+    lpIrq->lpszName = lpszName;
+    lpIrq->lpHandler = lpHandler;
+    lpIrq->lpThreadFunction = lpThreadFunction;
+    lpIrq->lpDevId = lpDevId;
+    lpIrq->iCpu = iCpu;
+    atomic_set(&lpIrq->iDisableDepth, 0);
+    InitializeHrtimer(&lpIrq->hrtTimer, SimulatedIrqTimerCallback);
+    if (iRate <= 0) {
+        return 0;
+    }
+    if (iRate > SIMULATED_IRQ_MAX_RATE) {
+        WRNPRINT("Rate of simulated %s is limited to %d Hz.\n", lpszName, SIMULATED_IRQ_MAX_RATE);
+        iRate = SIMULATED_IRQ_MAX_RATE;
+    }
+    if (lpThreadFunction) {
+        lpIrq->lpThread = kthread_create(SimulatedIrqThread, lpIrq, "irq/sim-%s", DRIVER_NAME);
+        if (IS_ERR(lpIrq->lpThread)) {
+            int iResult = PTR_ERR(lpIrq->lpThread);
+            lpIrq->lpThread = NULL;
+            return iResult;
+        }
+        if (S_INT_CPU_ANY != iCpu) {
+            kthread_bind(lpIrq->lpThread, iCpu);
+        }
+        wake_up_process(lpIrq->lpThread);
+    }
+    lpIrq->ktPeriod = ktime_set(0, NSEC_PER_SEC / iRate);
+    if (S_INT_CPU_ANY != iCpu) {
+        smp_call_function_single(iCpu, StartPinnedSimulatedIrq, lpIrq, 1); //The timer stays on the CPU it's started on
+        NFOPRINT("Simulating %s at %d Hz on CPU %d.\n", lpszName, iRate, iCpu);
+    }
+    else {
+        hrtimer_start(&lpIrq->hrtTimer, lpIrq->ktPeriod, HRTIMER_MODE_REL);
+        NFOPRINT("Simulating %s at %d Hz.\n", lpszName, iRate);
+    }
+    return 0;
+}
+
+//Stops generating a simulated interrupt, waits for its handler and thread function to finish
+static void FreeSimulatedIrq(unsigned int iIrq) {
+    struct interrupt_demo_simulated_irq * lpIrq = &arrSimulatedIrqs[iIrq];
+    if (!lpIrq->lpHandler) {
+        return;
+    }
+    hrtimer_cancel(&lpIrq->hrtTimer);
+    if (lpIrq->lpThread) {
+        kthread_stop(lpIrq->lpThread); //Runs the pending thread function before stopping
+        lpIrq->lpThread = NULL;
+    }
+    lpIrq->lpHandler = NULL;
+}
+
+//disable_irq(), disable_irq_nosync() and enable_irq() of simulated interrupts, they nest in the same way
+static inline void DisableDemoIrq(unsigned int iIrq) {
+    atomic_inc(&arrSimulatedIrqs[iIrq].iDisableDepth);
+}
+static inline void DisableDemoIrqNoSync(unsigned int iIrq) {
+    atomic_inc(&arrSimulatedIrqs[iIrq].iDisableDepth);
+}
+static inline void EnableDemoIrq(unsigned int iIrq) {
+    if (atomic_dec_return(&arrSimulatedIrqs[iIrq].iDisableDepth) < 0) {
+        WRNPRINT("Unbalanced enable for simulated %s.\n", arrSimulatedIrqs[iIrq].lpszName);
+        atomic_inc(&arrSimulatedIrqs[iIrq].iDisableDepth);
+    }
+}
+#else
+static inline void DisableDemoIrq(unsigned int iIrq) {
+    disable_irq(iIrq);
+}
+static inline void DisableDemoIrqNoSync(unsigned int iIrq) { //Doesn't wait for running handlers, so it's safe in the handler of the line itself
+    disable_irq_nosync(iIrq);
+}
+static inline void EnableDemoIrq(unsigned int iIrq) {
+    enable_irq(iIrq);
+}
+#endif
+
+/* IRQ Line Related Functions */
+//Entry of arrIrqLines. Simulated interrupt sources have no GPIO
+#ifdef IS_SIMULATED_INTERRUPT_SOURCE
+#define DEFINE_IRQ_LINE(iLineArgument, lpszLineName, iLineIrq, iLineGpio, lLineFlags, lpLineHandler, iLineProtection) {.lpszName = (lpszLineName), .iArgument = (iLineArgument), .iIrq = (iLineIrq), .lFlags = (lLineFlags), .lpHandler = (lpLineHandler), .iCpu = S_INT_CPU_ANY, .iProtection = (iLineProtection)}
+#else
+#define DEFINE_IRQ_LINE(iLineArgument, lpszLineName, iLineIrq, iLineGpio, lLineFlags, lpLineHandler, iLineProtection) {.lpszName = (lpszLineName), .iArgument = (iLineArgument), .iIrq = (iLineIrq), .iGpio = (iLineGpio), .lFlags = (lLineFlags), .lpHandler = (lpLineHandler), .iCpu = S_INT_CPU_ANY, .iProtection = (iLineProtection)}
+#endif
+static struct interrupt_demo_irq_line arrIrqLines[IRQ_LINE_COUNT] = {
+    [IRQ_LINE_S_INT] = DEFINE_IRQ_LINE(CTL_ARG_IRQ_NAME_S_INT, S_INT_NAME, S_INT, S_INT_LABEL, IRQ_TYPE_EDGE_FALLING, s_int_interrupt, 0), //Thread function and CPU are set by init()
+    [IRQ_LINE_DP_INT] = DEFINE_IRQ_LINE(CTL_ARG_IRQ_NAME_DP_INT, XEINT20_NAME, DP_INT, DP_INT_LABEL, IRQ_TYPE_EDGE_FALLING, dp_int_interrupt, 0),
+    [IRQ_LINE_PW_INT] = DEFINE_IRQ_LINE(CTL_ARG_IRQ_NAME_PW_INT, PW_INT_NAME, PW_INT, PW_INT_LABEL, IRQ_TYPE_EDGE_FALLING, pw_int_interrupt, IRQ_LINE_STORM_PROTECTED),
+    [IRQ_LINE_DAC_INT] = DEFINE_IRQ_LINE(CTL_ARG_IRQ_NAME_DAC_INT, DAC_INT_NAME, DAC_INT, DAC_INT_LABEL, IRQ_TYPE_EDGE_FALLING, dac_int_interrupt, 0),
+#ifdef IS_GPIO_INTERRUPT_DEBUG
+    [IRQ_LINE_KEY_HOME] = DEFINE_IRQ_LINE(CTL_ARG_IRQ_NAME_KEY_HOME, KEY_HOME_NAME, KEY_HOME, KEY_HOME_LABEL, IRQ_TYPE_EDGE_FALLING, key_interrupt, IRQ_LINE_DEBOUNCED | IRQ_LINE_STORM_PROTECTED),
+    [IRQ_LINE_KEY_BACK] = DEFINE_IRQ_LINE(CTL_ARG_IRQ_NAME_KEY_BACK, KEY_BACK_NAME, KEY_BACK, KEY_BACK_LABEL, IRQ_TYPE_EDGE_FALLING, key_interrupt, IRQ_LINE_DEBOUNCED | IRQ_LINE_STORM_PROTECTED),
+    [IRQ_LINE_KEY_SLEEP] = DEFINE_IRQ_LINE(CTL_ARG_IRQ_NAME_KEY_SLEEP, KEY_SLEEP_NAME, KEY_SLEEP, KEY_SLEEP_LABEL, IRQ_TYPE_EDGE_FALLING, key_interrupt, IRQ_LINE_DEBOUNCED | IRQ_LINE_STORM_PROTECTED),
+    [IRQ_LINE_KEY_VOLUP] = DEFINE_IRQ_LINE(CTL_ARG_IRQ_NAME_KEY_VOLUP, KEY_VOLUP_NAME, KEY_VOLUP, KEY_VOLUP_LABEL, IRQ_TYPE_EDGE_FALLING, key_interrupt, IRQ_LINE_DEBOUNCED | IRQ_LINE_STORM_PROTECTED),
+    [IRQ_LINE_KEY_VOLDOWN] = DEFINE_IRQ_LINE(CTL_ARG_IRQ_NAME_KEY_VOLDOWN, KEY_VOLDOWN_NAME, KEY_VOLDOWN, KEY_VOLDOWN_LABEL, IRQ_TYPE_EDGE_FALLING, key_interrupt, IRQ_LINE_DEBOUNCED | IRQ_LINE_STORM_PROTECTED),
+#endif
+};
+
+//Timer callback unmasking a line after its debounce time or storm backoff, runs in hard IRQ context
+static enum hrtimer_restart IrqRearmTimerCallback(struct hrtimer * lpTimer) {
+    EnableDemoIrq(container_of(lpTimer, struct interrupt_demo_irq_line, hrtRearmTimer)->iIrq);
+    return HRTIMER_NORESTART;
+}
+
+//Returns true if a storm protected line has exceeded iIrqStormLimit interrupts in the current one-second window, called by DispatchIrq() of this line only
+static inline bool IsIrqStorm(struct interrupt_demo_irq_line * lpLine) {
+    unsigned int iLimit = ACCESS_ONCE(iIrqStormLimit);
+    u64 lNow;
+    if (0 == iLimit) {
+        return false;
+    }
+    lNow = ktime_to_ns(ktime_get());
+    if (lNow - lpLine->lStormWindowStart >= NSEC_PER_SEC) {
+        lpLine->lStormWindowStart = lNow;
+        lpLine->iStormWindowEvents = 0;
+    }
+    return ++lpLine->iStormWindowEvents > iLimit;
 }
+
+/*
+ * DispatchIrq() Function
+ *
+ * This function is the top half of every IRQ line, lpDevId is the line. It counts the interrupt, then calls the handler of the line.
+ * A storm protected line exceeding iIrqStormLimit is masked for IRQ_STORM_BACKOFF_TIME instead, its interrupts are counted but not handled. A debounced line is masked for iKeyDebounceTime after its handler.
+ * So a bouncing key or a noisy line costs at most a few interrupts, however fast it toggles.
+ *
+ */
+static irqreturn_t DispatchIrq(int iIrq, void * lpDevId) {
+    struct interrupt_demo_irq_line * lpLine = lpDevId;
+    irqreturn_t iResult;
+    ++lpLine->lEvents;
+    if ((lpLine->iProtection & IRQ_LINE_STORM_PROTECTED) && IsIrqStorm(lpLine)) {
+        DisableDemoIrqNoSync(iIrq);
+        ++lpLine->lStorms;
+        lpLine->lStormWindowStart = 0; //Count from scratch once unmasked
+        hrtimer_start(&lpLine->hrtRearmTimer, ns_to_ktime((u64)IRQ_STORM_BACKOFF_TIME * NSEC_PER_MSEC), HRTIMER_MODE_REL);
+        WRNPRINT("IRQ storm on %s, more than %u IRQs per second, masked for %d ms.\n", lpLine->lpszName, iIrqStormLimit, IRQ_STORM_BACKOFF_TIME); //At most once per backoff
+        return IRQ_HANDLED;
+    }
+    iResult = lpLine->lpHandler(iIrq, lpDevId);
+    if ((lpLine->iProtection & IRQ_LINE_DEBOUNCED) && ACCESS_ONCE(iKeyDebounceTime)) {
+        DisableDemoIrqNoSync(iIrq);
+        hrtimer_start(&lpLine->hrtRearmTimer, ns_to_ktime((u64)ACCESS_ONCE(iKeyDebounceTime) * NSEC_PER_USEC), HRTIMER_MODE_REL);
+    }
+    return iResult;
+}
+
+//Returns the IRQ line selected by a CTL_ARG_IRQ_NAME_* argument, other arguments select S_INT as they always have
+static inline struct interrupt_demo_irq_line * GetIrqLine(unsigned long lArgument) {
+    struct interrupt_demo_irq_line * lpLine = lArgument <= CTL_ARG_IRQ_NAME_MAX ? arrIrqLinesByArgument[lArgument] : NULL;
+    return lpLine ? lpLine : &arrIrqLines[IRQ_LINE_S_INT];
+}
+
+/*
+ * RequestDemoIrq() Function
+ *
+ * This function configures the GPIO of an IRQ line and requests its interrupt, with the line as dev_id.
+ * If iCpu of the line isn't S_INT_CPU_ANY, the interrupt is pinned to that CPU.
+ * Returns 0 on success, or a negative error code, in which case the line stays unused.
+ *
+ */
+static int RequestDemoIrq(struct interrupt_demo_irq_line * lpLine) {
+    int iResult;
+    InitializeHrtimer(&lpLine->hrtRearmTimer, IrqRearmTimerCallback);
+#ifdef IS_SIMULATED_INTERRUPT_SOURCE
+    iResult = RequestSimulatedIrq(lpLine->iIrq, DispatchIrq, lpLine->lpThreadFunction, lpLine->lpszName, lpLine->iCpu, lpLine);
+    if (iResult < 0) {
+        WRNPRINT("Request simulated IRQ %s failed with return code %d.\n", lpLine->lpszName, iResult);
+        return iResult;
+    }
+#else
+    iResult = gpio_request(lpLine->iGpio, lpLine->lpszName);
+    if (iResult) {
+        WRNPRINT("Request GPIO %d failed with return code %d.\n", lpLine->iGpio, iResult);
+        return iResult;
+    }
+    s3c_gpio_cfgpin(lpLine->iGpio, S3C_GPIO_SFN(0xF));
+    s3c_gpio_setpull(lpLine->iGpio, S3C_GPIO_PULL_UP);
+    gpio_free(lpLine->iGpio);
+    iResult = request_threaded_irq(lpLine->iIrq, DispatchIrq, lpLine->lpThreadFunction, lpLine->lFlags, lpLine->lpszName, lpLine); //Same as request_irq() if there is no thread function
+    if (iResult < 0) {
+        WRNPRINT("Request IRQ %d failed with return code %d.\n", lpLine->iIrq, iResult);
+        return iResult;
+    }
+    if (S_INT_CPU_ANY != lpLine->iCpu) {
+        SetIrqAffinity(lpLine->iIrq, cpumask_of(lpLine->iCpu)); //The IRQ thread follows the affinity of its IRQ
+        NFOPRINT("%s is pinned to CPU %d.\n", lpLine->lpszName, lpLine->iCpu);
+    }
+#endif
+    lpLine->bIsRequested = true;
+    return 0;
+}
+
+//Frees the interrupt of an IRQ line, if RequestDemoIrq() has obtained it. The line may be left masked, free_irq() doesn't care
+static void FreeDemoIrq(struct interrupt_demo_irq_line * lpLine) {
+    if (!lpLine->bIsRequested) {
+        return;
+    }
+    DisableDemoIrq(lpLine->iIrq);
+#ifdef IS_SIMULATED_INTERRUPT_SOURCE
+    FreeSimulatedIrq(lpLine->iIrq); //Waits for a running handler, which may still start the rearm timer. Its EnableDemoIrq() is harmless afterwards
+    hrtimer_cancel(&lpLine->hrtRearmTimer);
+#else
+    hrtimer_cancel(&lpLine->hrtRearmTimer); //disable_irq() has waited for running handlers, no one can start the rearm timer any more. Cancelling it before free_irq() keeps it from unmasking a freed line
+    if (S_INT_CPU_ANY != lpLine->iCpu) {
+        ClearIrqAffinity(lpLine->iIrq);
+    }
+    free_irq(lpLine->iIrq, lpLine);
+#endif
+    lpLine->bIsRequested = false;
+}
+
+#ifdef IS_IRQ_STATISTICS_REQUESTED
+/*
+ * interrupt_demo_lines_show() Function
+ *
+ * This function prints every IRQ line to /sys/kernel/debug/interrupt-demo/lines, with its number of interrupts and its average rate since the previous read of the file.
+ *
+ */
+static int interrupt_demo_lines_show(struct seq_file * lpSeqFile, void * lpData) {
+    static u64 lShownTimestamp; //Time of the previous read, 0 before the first one
+    u64 lNow = ktime_to_ns(ktime_get());
+    u64 lElapsed = lShownTimestamp ? lNow - lShownTimestamp : 0;
+    unsigned int iLine;
+    for (iLine = 0; iLine < IRQ_LINE_COUNT; ++iLine) {
+        struct interrupt_demo_irq_line * lpLine = &arrIrqLines[iLine];
+        unsigned long lEvents = ACCESS_ONCE(lpLine->lEvents);
+        if (!lpLine->bIsRequested) {
+            seq_printf(lpSeqFile, "%s: not requested\n", lpLine->lpszName);
+            continue;
+        }
+        seq_printf(lpSeqFile, "%s: IRQ %u, %lu IRQs", lpLine->lpszName, lpLine->iIrq, lEvents);
+        if (lpLine->iProtection & IRQ_LINE_STORM_PROTECTED) {
+            seq_printf(lpSeqFile, ", %lu storms", ACCESS_ONCE(lpLine->lStorms));
+        }
+        if (lElapsed) {
+            seq_printf(lpSeqFile, ", %llu Hz", div64_u64((u64)(lEvents - lpLine->lShownEvents) * NSEC_PER_SEC, lElapsed));
+        }
+        seq_puts(lpSeqFile, "\n");
+        lpLine->lShownEvents = lEvents;
+    }
+    lShownTimestamp = lNow;
+    return 0;
+}
+
+static int interrupt_demo_lines_open(struct inode * lpNode, struct file * lpFile) {
+    return single_open(lpFile, interrupt_demo_lines_show, NULL);
+}
+
+static const struct file_operations interrupt_demo_lines_file_operations = {
+    .owner = THIS_MODULE,
+    .open = interrupt_demo_lines_open,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
 #endif
 
 /* Platform Device Related Functions */
@@ -302,141 +2853,263 @@ static int interrupt_demo_resume(struct platform_device * lpPlatformDevice) {
 }
 
 /* IOControl Handlers */
-void ProcessIoControlCommand(unsigned int iIoControlCommand, unsigned long lpIoControlParameters) {
+//Returns true if the command is known and its argument is in range, used to check typed requests and batches before applying them
+static bool IsIoControlCommandValid(unsigned int iIoControlCommand, unsigned long lpIoControlParameters) {
     switch (iIoControlCommand) {
     case CTL_CMD_DISABLE_IRQ:
-        switch (lpIoControlParameters) {
-        case CTL_ARG_IRQ_NAME_NULL:
-            break;
-        case CTL_ARG_IRQ_NAME_S_INT:
-            DBGPRINT("Disabling IRQ: S_INT.\n");
-            disable_irq(S_INT);
-            break;
-        case CTL_ARG_IRQ_NAME_DP_INT:
-            DBGPRINT("Disabling IRQ: DP_INT.\n");
-            disable_irq(DP_INT);
-            break;
-        case CTL_ARG_IRQ_NAME_PW_INT:
-            DBGPRINT("Disabling IRQ: PW_INT.\n");
-            disable_irq(PW_INT);
-            break;
-        case CTL_ARG_IRQ_NAME_DAC_INT:
-            DBGPRINT("Disabling IRQ: DAC_INT.\n");
-            disable_irq(DAC_INT);
-            break;
-#ifdef IS_GPIO_INTERRUPT_DEBUG
-        case CTL_ARG_IRQ_NAME_KEY_HOME:
-            DBGPRINT("Disabling IRQ: KEY_HOME.\n");
-            disable_irq(KEY_HOME);
-            break;
-        case CTL_ARG_IRQ_NAME_KEY_BACK:
-            DBGPRINT("Disabling IRQ: KEY_BACK.\n");
-            disable_irq(KEY_BACK);
-            break;
-        case CTL_ARG_IRQ_NAME_KEY_SLEEP:
-            DBGPRINT("Disabling IRQ: KEY_SLEEP.\n");
-            disable_irq(KEY_SLEEP);
-            break;
-        case CTL_ARG_IRQ_NAME_KEY_VOLUP:
-            DBGPRINT("Disabling IRQ: KEY_VOLUP.\n");
-            disable_irq(KEY_VOLUP);
-            break;
-        case CTL_ARG_IRQ_NAME_KEY_VOLDOWN:
-            DBGPRINT("Disabling IRQ: KEY_VOLDOWN.\n");
-            disable_irq(KEY_VOLDOWN);
-            break;
-#endif
-        default:
-            //Disables S_INT by default
-            DBGPRINT("Disabling IRQ: S_INT.\n");
-            disable_irq(S_INT);
+    case CTL_CMD_ENABLE_IRQ:
+    case CTL_CMD_SET_USER_APP_PID:
+    case CTL_CMD_SET_RATE:
+    case CTL_CMD_SET_OVERFLOW_MODE:
+    case CTL_CMD_SET_CHANNEL_LAYOUT:
+        return true;
+    case CTL_CMD_SET_DELAY_HIGH_BYTE:
+    case CTL_CMD_SET_DELAY_LOW_BYTE:
+    case CTL_CMD_SET_COMPRESS_COUNT_HIGH_BYTE:
+    case CTL_CMD_SET_COMPRESS_COUNT_LOW_BYTE:
+    case CTL_CMD_SET_COMPRESS_STEP_INT_PART:
+    case CTL_CMD_SET_COMPRESS_STEP_FLOAT_PART:
+        return lpIoControlParameters <= 0xFF;
+    case CTL_CMD_SET_GAIN:
+        return lpIoControlParameters <= DATA_GAIN_MAX;
+    case CTL_CMD_SET_DELAY:
+    case CTL_CMD_SET_COMPRESS_COUNT:
+    case CTL_CMD_SET_COMPRESS_STEP:
+    case CTL_CMD_SET_PULSE_BASELINE:
+    case CTL_CMD_SET_PULSE_THRESHOLD:
+    case CTL_CMD_SET_TRIGGER_LEVEL:
+    case CTL_CMD_SET_TRIGGER_POST_FRAMES:
+    case CTL_CMD_SET_TRIGGER_HOLDOFF:
+        return lpIoControlParameters <= 0xFFFF;
+    case CTL_CMD_TRIGGER_S_INT:
+        return lpIoControlParameters <= CTL_ARG_TRIGGER_S_INT_MAX_COUNT;
+    case CTL_CMD_SET_TRIGGER_MODE:
+        return lpIoControlParameters <= CTL_ARG_TRIGGER_MODE_FALLING;
+    case CTL_CMD_SET_TRIGGER_PRE_FRAMES:
+        return lpIoControlParameters <= TRIGGER_MAX_PRE_FRAMES;
+    case CTL_CMD_SET_TRIGGER_CHANNEL:
+        return lpIoControlParameters < iDataChannelCount;
+    case CTL_CMD_SET_PULSE_MODE:
+        return lpIoControlParameters <= CTL_ARG_PULSE_MODE_APPEND;
+    case CTL_CMD_SET_COMPRESS_MODE:
+        return lpIoControlParameters <= CTL_ARG_COMPRESS_MODE_MAX;
+    case CTL_CMD_SET_SAMPLE_FORMAT:
+        return lpIoControlParameters <= CTL_ARG_SAMPLE_FORMAT_DELTA_VARINT;
+    case CTL_CMD_SET_READ_MODE:
+        return lpIoControlParameters <= CTL_ARG_READ_MODE_BATCH;
+    case CTL_CMD_SET_WAKEUP_TIMEOUT:
+        return lpIoControlParameters <= UINT_MAX;
+    case CTL_CMD_SET_WAKEUP_ALIGN:
+        return lpIoControlParameters <= CTL_ARG_WAKEUP_ALIGN_DP_INT;
+    case CTL_CMD_SET_PLAYBACK_WATERMARK:
+        return lpIoControlParameters < plbPlayback.iDepth;
+    case CTL_CMD_SET_WAKEUP_THRESHOLD:
+        return lpIoControlParameters >= 1 && lpIoControlParameters <= arrDataRings[0].iDepth;
+    case CTL_CMD_SET_TEMPLATE:
+        return lpIoControlParameters < WAVEFORM_TEMPLATE_COUNT && NULL != rcu_access_pointer(arrTemplates[lpIoControlParameters]);
+    case CTL_CMD_SET_CHANNEL:
+        return CTL_ARG_CHANNEL_ALL == lpIoControlParameters || lpIoControlParameters < iDataChannelCount;
+    default:
+        return false;
+    }
+}
+
+/*
+ * ProcessIoControlCommand() Function
+ *
+ * This function applies an IO control command. Callers must hold mtxIoCtlLock, and call PublishSettings() afterwards to make changes of setPendingSettings take effect.
+ * Returns 0, or a negative error code if the command is unknown or its argument is invalid.
+ *
+ */
+static long ProcessIoControlCommand(unsigned int iIoControlCommand, unsigned long lpIoControlParameters) {
+    unsigned int iChannel;
+    struct interrupt_demo_irq_line * lpLine;
+    switch (iIoControlCommand) {
+    case CTL_CMD_DISABLE_IRQ:
+        if (CTL_ARG_IRQ_NAME_NULL == lpIoControlParameters) {
             break;
         }
+        lpLine = GetIrqLine(lpIoControlParameters);
+        if (!lpLine->bIsRequested) {
+            WRNPRINT("IRQ %s is not requested.\n", lpLine->lpszName);
+            return -ENODEV;
+        }
+        DBGPRINT("Disabling IRQ: %s.\n", lpLine->lpszName);
+        DisableDemoIrq(lpLine->iIrq);
         break;
     case CTL_CMD_ENABLE_IRQ:
-        switch (lpIoControlParameters) {
-        case CTL_ARG_IRQ_NAME_NULL:
-            break;
-        case CTL_ARG_IRQ_NAME_S_INT:
-            DBGPRINT("Enabling IRQ: S_INT.\n");
-            enable_irq(S_INT);
-            break;
-        case CTL_ARG_IRQ_NAME_DP_INT:
-            DBGPRINT("Enabling IRQ: DP_INT.\n");
-            enable_irq(DP_INT);
-            break;
-        case CTL_ARG_IRQ_NAME_PW_INT:
-            DBGPRINT("Enabling IRQ: PW_INT.\n");
-            enable_irq(PW_INT);
-            break;
-        case CTL_ARG_IRQ_NAME_DAC_INT:
-            DBGPRINT("Enabling IRQ: DAC_INT.\n");
-            enable_irq(DAC_INT);
-            break;
-#ifdef IS_GPIO_INTERRUPT_DEBUG
-        case CTL_ARG_IRQ_NAME_KEY_HOME:
-            DBGPRINT("Enabling IRQ: KEY_HOME.\n");
-            enable_irq(KEY_HOME);
-            break;
-        case CTL_ARG_IRQ_NAME_KEY_BACK:
-            DBGPRINT("Enabling IRQ: KEY_BACK.\n");
-            enable_irq(KEY_BACK);
-            break;
-        case CTL_ARG_IRQ_NAME_KEY_SLEEP:
-            DBGPRINT("Enabling IRQ: KEY_SLEEP.\n");
-            enable_irq(KEY_SLEEP);
-            break;
-        case CTL_ARG_IRQ_NAME_KEY_VOLUP:
-            DBGPRINT("Enabling IRQ: KEY_VOLUP.\n");
-            enable_irq(KEY_VOLUP);
-            break;
-        case CTL_ARG_IRQ_NAME_KEY_VOLDOWN:
-            DBGPRINT("Enabling IRQ: KEY_VOLDOWN.\n");
-            enable_irq(KEY_VOLDOWN);
-            break;
-#endif
-        default:
-            //Enables S_INT by default
-            DBGPRINT("Enabling IRQ: S_INT.\n");
-            enable_irq(S_INT);
+        if (CTL_ARG_IRQ_NAME_NULL == lpIoControlParameters) {
             break;
         }
+        lpLine = GetIrqLine(lpIoControlParameters);
+        if (!lpLine->bIsRequested) {
+            WRNPRINT("IRQ %s is not requested.\n", lpLine->lpszName);
+            return -ENODEV;
+        }
+        DBGPRINT("Enabling IRQ: %s.\n", lpLine->lpszName);
+        EnableDemoIrq(lpLine->iIrq);
         break;
     case CTL_CMD_SET_USER_APP_PID:
 
         break;
     case CTL_CMD_SET_DELAY_HIGH_BYTE:
-
+        setPendingSettings.iDelay = (setPendingSettings.iDelay & 0x00FF) | ((lpIoControlParameters & 0xFF) << 8);
+        DBGPRINT("Delay is set to %u.\n", setPendingSettings.iDelay);
         break;
     case CTL_CMD_SET_DELAY_LOW_BYTE:
-
+        setPendingSettings.iDelay = (setPendingSettings.iDelay & 0xFF00) | (lpIoControlParameters & 0xFF);
+        DBGPRINT("Delay is set to %u.\n", setPendingSettings.iDelay);
+        break;
+    case CTL_CMD_SET_DELAY:
+        setPendingSettings.iDelay = lpIoControlParameters & 0xFFFF;
+        DBGPRINT("Delay is set to %u.\n", setPendingSettings.iDelay);
+        break;
+    case CTL_CMD_SET_COMPRESS_COUNT:
+        setPendingSettings.iCompressCount = lpIoControlParameters & 0xFFFF;
+        DBGPRINT("Compress Count is set to %u.\n", setPendingSettings.iCompressCount);
+        break;
+    case CTL_CMD_SET_COMPRESS_STEP:
+        setPendingSettings.iCompressStep = lpIoControlParameters & 0xFFFF;
+        DBGPRINT("Compress Step is set to %u/%u.\n", setPendingSettings.iCompressStep, 1 << COMPRESS_STEP_FRACTION_BITS);
         break;
     case CTL_CMD_SET_RATE:
 
         break;
     case CTL_CMD_SET_COMPRESS_COUNT_HIGH_BYTE:
-
+        setPendingSettings.iCompressCount = (setPendingSettings.iCompressCount & 0x00FF) | ((lpIoControlParameters & 0xFF) << 8);
+        DBGPRINT("Compress Count is set to %u.\n", setPendingSettings.iCompressCount);
         break;
     case CTL_CMD_SET_COMPRESS_COUNT_LOW_BYTE:
-
+        setPendingSettings.iCompressCount = (setPendingSettings.iCompressCount & 0xFF00) | (lpIoControlParameters & 0xFF);
+        DBGPRINT("Compress Count is set to %u.\n", setPendingSettings.iCompressCount);
         break;
     case CTL_CMD_SET_COMPRESS_STEP_INT_PART:
-
+        setPendingSettings.iCompressStep = (setPendingSettings.iCompressStep & ((1 << COMPRESS_STEP_FRACTION_BITS) - 1)) | ((lpIoControlParameters & 0xFF) << COMPRESS_STEP_FRACTION_BITS);
+        DBGPRINT("Compress Step is set to %u/%u.\n", setPendingSettings.iCompressStep, 1 << COMPRESS_STEP_FRACTION_BITS);
         break;
     case CTL_CMD_SET_COMPRESS_STEP_FLOAT_PART:
-
+        setPendingSettings.iCompressStep = (setPendingSettings.iCompressStep & ~((1 << COMPRESS_STEP_FRACTION_BITS) - 1)) | (lpIoControlParameters & ((1 << COMPRESS_STEP_FRACTION_BITS) - 1));
+        DBGPRINT("Compress Step is set to %u/%u.\n", setPendingSettings.iCompressStep, 1 << COMPRESS_STEP_FRACTION_BITS);
         break;
     case CTL_CMD_SET_GAIN:
-
+        if (lpIoControlParameters > DATA_GAIN_MAX) { //write() and the raw IO control skip IsIoControlCommandValid()
+            WRNPRINT("Invalid gain %lu, the max is %u.\n", lpIoControlParameters, DATA_GAIN_MAX);
+            return -EINVAL;
+        }
+        if (CTL_ARG_CHANNEL_ALL == iCurrentChannel) {
+            DBGPRINT("Setting gain of all channels to %lu/%u.\n", lpIoControlParameters, DATA_GAIN_UNITY);
+            for (iChannel = 0; iChannel < iDataChannelCount; ++iChannel) {
+                setPendingSettings.arrChannelGains[iChannel] = lpIoControlParameters;
+            }
+        }
+        else {
+            DBGPRINT("Setting gain of channel %u to %lu/%u.\n", iCurrentChannel, lpIoControlParameters, DATA_GAIN_UNITY);
+            setPendingSettings.arrChannelGains[iCurrentChannel] = lpIoControlParameters;
+        }
         break;
     case CTL_CMD_SET_CHANNEL:
-
+        if (CTL_ARG_CHANNEL_ALL != lpIoControlParameters && lpIoControlParameters >= iDataChannelCount) {
+            WRNPRINT("Invalid channel %lu, there are %d channels.\n", lpIoControlParameters, iDataChannelCount);
+            return -EINVAL;
+        }
+        DBGPRINT("Setting current channel to %lu.\n", lpIoControlParameters);
+        ACCESS_ONCE(iCurrentChannel) = lpIoControlParameters;
+        wake_up_interruptible(&wqDataRingReadQueue); //Readiness depends on the current channel
         break;
-    default:
-
+    case CTL_CMD_TRIGGER_S_INT:
+        lpIoControlParameters = GetMin(GetMax(lpIoControlParameters, 1), CTL_ARG_TRIGGER_S_INT_MAX_COUNT); //Clamped for write() and the raw IO control, which skip IsIoControlCommandValid()
+        DBGPRINT("Triggering %lu S_INT(s) by software.\n", lpIoControlParameters);
+        PublishSettings(); //Software S_INTs use the settings of earlier commands
+        TriggerSoftwareSInt(lpIoControlParameters);
+        break;
+    case CTL_CMD_SET_COMPRESS_MODE:
+        DBGPRINT("Setting Compress Mode to %lu.\n", lpIoControlParameters);
+        setPendingSettings.iCompressMode = lpIoControlParameters;
+        break;
+    case CTL_CMD_SET_OVERFLOW_MODE:
+        DBGPRINT("Setting Frame Ring overflow mode to %lu.\n", lpIoControlParameters);
+        for (iChannel = 0; iChannel < iDataChannelCount; ++iChannel) {
+            ACCESS_ONCE(arrDataRings[iChannel].lpControl->iOverflowMode) = lpIoControlParameters ? DATA_RING_OVERFLOW_OVERWRITE_OLDEST : DATA_RING_OVERFLOW_DROP_NEWEST;
+        }
+        break;
+    case CTL_CMD_SET_SAMPLE_FORMAT:
+        if (lpIoControlParameters > CTL_ARG_SAMPLE_FORMAT_DELTA_VARINT) {
+            WRNPRINT("Invalid sample format %lu.\n", lpIoControlParameters);
+            return -EINVAL;
+        }
+        DBGPRINT("Setting sample format to %lu.\n", lpIoControlParameters);
+        setPendingSettings.iSampleFormat = lpIoControlParameters;
+        break;
+    case CTL_CMD_SET_READ_MODE:
+        DBGPRINT("Setting read mode to %lu.\n", lpIoControlParameters);
+        ACCESS_ONCE(iReadMode) = lpIoControlParameters ? CTL_ARG_READ_MODE_BATCH : CTL_ARG_READ_MODE_SINGLE_FRAME;
+        break;
+    case CTL_CMD_SET_PULSE_MODE:
+        if (lpIoControlParameters > CTL_ARG_PULSE_MODE_APPEND) {
+            WRNPRINT("Invalid pulse mode %lu.\n", lpIoControlParameters);
+            return -EINVAL;
+        }
+        DBGPRINT("Setting pulse mode to %lu.\n", lpIoControlParameters);
+        setPendingSettings.iPulseMode = lpIoControlParameters;
+        break;
+    case CTL_CMD_SET_PULSE_BASELINE:
+        setPendingSettings.iPulseBaseline = lpIoControlParameters & 0xFFFF;
+        DBGPRINT("Pulse Baseline is set to %u.\n", setPendingSettings.iPulseBaseline);
+        break;
+    case CTL_CMD_SET_PULSE_THRESHOLD:
+        setPendingSettings.iPulseThreshold = lpIoControlParameters & 0xFFFF;
+        DBGPRINT("Pulse Threshold is set to %u.\n", setPendingSettings.iPulseThreshold);
+        break;
+    case CTL_CMD_SET_TRIGGER_MODE:
+        if (lpIoControlParameters > CTL_ARG_TRIGGER_MODE_FALLING) {
+            WRNPRINT("Invalid trigger mode %lu.\n", lpIoControlParameters);
+            return -EINVAL;
+        }
+        DBGPRINT("Setting trigger mode to %lu.\n", lpIoControlParameters);
+        setPendingSettings.iTriggerMode = lpIoControlParameters;
+        break;
+    case CTL_CMD_SET_TRIGGER_LEVEL:
+        setPendingSettings.iTriggerLevel = lpIoControlParameters & 0xFFFF;
+        DBGPRINT("Trigger Level is set to %u.\n", setPendingSettings.iTriggerLevel);
         break;
+    case CTL_CMD_SET_TRIGGER_CHANNEL:
+        if (lpIoControlParameters >= iDataChannelCount) {
+            WRNPRINT("Invalid trigger channel %lu, there are %d channels.\n", lpIoControlParameters, iDataChannelCount);
+            return -EINVAL;
+        }
+        DBGPRINT("Setting trigger source channel to %lu.\n", lpIoControlParameters);
+        setPendingSettings.iTriggerChannel = lpIoControlParameters;
+        break;
+    case CTL_CMD_SET_TRIGGER_PRE_FRAMES:
+        setPendingSettings.iTriggerPreFrames = GetMin(lpIoControlParameters, TRIGGER_MAX_PRE_FRAMES);
+        DBGPRINT("Trigger PreFrames is set to %u.\n", setPendingSettings.iTriggerPreFrames);
+        break;
+    case CTL_CMD_SET_TRIGGER_POST_FRAMES:
+        setPendingSettings.iTriggerPostFrames = lpIoControlParameters & 0xFFFF;
+        DBGPRINT("Trigger PostFrames is set to %u.\n", setPendingSettings.iTriggerPostFrames);
+        break;
+    case CTL_CMD_SET_TRIGGER_HOLDOFF:
+        setPendingSettings.iTriggerHoldoff = lpIoControlParameters & 0xFFFF;
+        DBGPRINT("Trigger Holdoff is set to %u.\n", setPendingSettings.iTriggerHoldoff);
+        break;
+    case CTL_CMD_SET_TEMPLATE:
+        if (lpIoControlParameters >= WAVEFORM_TEMPLATE_COUNT || NULL == rcu_access_pointer(arrTemplates[lpIoControlParameters])) {
+            WRNPRINT("Template slot %lu is not loaded.\n", lpIoControlParameters);
+            return -EINVAL;
+        }
+        DBGPRINT("Setting waveform template to slot %lu.\n", lpIoControlParameters);
+        setPendingSettings.iTemplate = lpIoControlParameters;
+        break;
+    case CTL_CMD_SET_CHANNEL_LAYOUT:
+        DBGPRINT("Setting channel layout to %lu.\n", lpIoControlParameters);
+        ACCESS_ONCE(iChannelLayout) = lpIoControlParameters ? CTL_ARG_CHANNEL_LAYOUT_INTERLEAVED : CTL_ARG_CHANNEL_LAYOUT_PLANAR;
+        break;
+    case CTL_CMD_SET_PLAYBACK_WATERMARK:
+        return SetPlaybackWatermark(lpIoControlParameters);
+    default:
+        return -ENOTTY;
     }
-    return;
+    return 0;
 }
 
 /* Init & Exit Functions */
@@ -455,200 +3128,158 @@ static void interrupt_demo_setup_cdev(struct cdev * lpCharDevice, int iMinorDevi
 static int __init interrupt_demo_init(void) {
     NFOPRINT("Initializing...\n");
     int iResult;
-    dev_t devDeviceNumber = MKDEV(iMajorDeviceNumber, 0);
+    //Allocate Frame Rings before the device becomes visible
+    iDataChannelCount = GetMin(GetMax(iDataChannelCount, 1), DATA_CHANNEL_MAX_COUNT);
+    unsigned int iChannel;
+    for (iChannel = 0; iChannel < iDataChannelCount; ++iChannel) {
+        iResult = InitializeDataRing(&arrDataRings[iChannel], iDataRingDepth, iChannel);
+        if (iResult < 0) {
+            ERRPRINT("Failed to allocate Frame Ring of %d frames for channel %u.\n", iDataRingDepth, iChannel);
+            while (iChannel--) {
+                FreeDataRing(&arrDataRings[iChannel]);
+            }
+            return iResult;
+        }
+    }
+    //Allocate Playback Ring before DAC_INT and the device
+    iResult = InitializePlaybackRing(&plbPlayback, iPlaybackRingDepth);
+    if (iResult < 0) {
+        ERRPRINT("Failed to allocate Playback Ring of %d blocks.\n", iPlaybackRingDepth);
+        for (iChannel = 0; iChannel < iDataChannelCount; ++iChannel) {
+            FreeDataRing(&arrDataRings[iChannel]);
+        }
+        return iResult;
+    }
+    dev_t devDeviceNumber = MKDEV(iMajorDeviceNumber, MINOR_FRAMES);
     if (iMajorDeviceNumber) {
         //Static device number
-        iResult = register_chrdev_region(devDeviceNumber, 1, DEVICE_NAME);
+        iResult = register_chrdev_region(devDeviceNumber, MINOR_DEVICE_COUNT, DEVICE_NAME);
         DBGPRINT("register_chrdev_region().\n");
     }
     else {
         //Allocate device number
-        iResult = alloc_chrdev_region(&devDeviceNumber, 0, 1, DEVICE_NAME);
+        iResult = alloc_chrdev_region(&devDeviceNumber, MINOR_FRAMES, MINOR_DEVICE_COUNT, DEVICE_NAME);
         DBGPRINT("alloc_chrdev_region().\n");
         iMajorDeviceNumber = MAJOR(devDeviceNumber);
     }
     if (iResult < 0) { //Errors occurred
         WRNPRINT("alloc_chrdev_region() failed.\n");
+        FreePlaybackRing(&plbPlayback);
+        for (iChannel = 0; iChannel < iDataChannelCount; ++iChannel) {
+            FreeDataRing(&arrDataRings[iChannel]);
+        }
         return iResult;
     }
-    interrupt_demo_setup_cdev(&cdevDevice, 0, &interrupt_demo_device_file_operations);
+    //Initialize IRQ Event FIFO before its device and any auxiliary interrupt
+    mutex_init(&mtxIrqEventReadLock);
+    init_waitqueue_head(&wqIrqEventReadQueue);
+    //Initialize Playback Ring producers before its device and DAC_INT
+    mutex_init(&mtxPlaybackWriteLock);
+    init_waitqueue_head(&wqPlaybackWriteQueue);
+    interrupt_demo_setup_cdev(&cdevDevice, MINOR_FRAMES, &interrupt_demo_device_file_operations);
+    interrupt_demo_setup_cdev(&cdevEventsDevice, MINOR_EVENTS, &interrupt_demo_events_file_operations);
+    interrupt_demo_setup_cdev(&cdevPlaybackDevice, MINOR_PLAYBACK, &interrupt_demo_playback_file_operations);
     DBGPRINT("The major device number of this device is %d.\n", iMajorDeviceNumber);
 #ifdef IS_DATA_BUFFER_SPINLOCK_REQUESTED
-    //Initialize Read-Write-Lock for arrDataBuffer
-    rwlock_init(&rwlkDataBufferLock);
+    //Initialize Spin-Lock for Frame Ring producers
+    spin_lock_init(&spnlkDataBufferLock);
 #endif
-#ifdef IS_IOCTL_OPERATION_SPINLOCK_REQUESTED
-    //Initialize Spin-Lock for IO Control
-    spin_lock_init(&spnlkIoCtlLock);
+    //Initialize Mutex for Frame Ring consumers
+    mutex_init(&mtxDataRingReadLock);
+    //Initialize waveform templates and noise generators before any S_INT
+    InitializeWaveformGenerator();
+    //Initialize Wait Queue for Frame Ring consumers
+    init_waitqueue_head(&wqDataRingReadQueue);
+    //Initialize DP_INT snapshot for consumers aligned to DP_INT
+    seqcount_init(&scDpIntTick);
+#ifdef IS_IOCTL_OPERATION_MUTEX_REQUESTED
+    //Initialize Mutex for IO Control
+    mutex_init(&mtxIoCtlLock);
 #endif
-    //Use request_irq() to register interrupts here
-    int iIrqResult;
-    //Request interrupt S_INT
-    iIrqResult = gpio_request(S_INT_LABEL, S_INT_NAME);
-    if (0 == iIrqResult) {
-        s3c_gpio_cfgpin(S_INT_LABEL, S3C_GPIO_SFN(0xF));
-        s3c_gpio_setpull(S_INT_LABEL, S3C_GPIO_PULL_UP);
-        gpio_free(S_INT_LABEL);
-
-        iIrqResult = request_irq(S_INT, s_int_interrupt, IRQ_TYPE_EDGE_FALLING, S_INT_NAME, NULL);
-        if (iIrqResult < 0) {
-            WRNPRINT("Request IRQ %d failed with return code %d.\n", S_INT, iIrqResult);
-        }
-    }
-    else {
-        WRNPRINT("Request GPIO %d failed with return code %d.\n", S_INT_LABEL, iIrqResult);
-    }
-    //Request interrupt DP_INT
-    iIrqResult = gpio_request(DP_INT_LABEL, XEINT20_NAME);
-    if (0 == iIrqResult) {
-        s3c_gpio_cfgpin(DP_INT_LABEL, S3C_GPIO_SFN(0xF));
-        s3c_gpio_setpull(DP_INT_LABEL, S3C_GPIO_PULL_UP);
-        gpio_free(DP_INT_LABEL);
-
-        iIrqResult = request_irq(DP_INT, dp_int_interrupt, IRQ_TYPE_EDGE_FALLING, XEINT20_NAME, NULL);
-        if (iIrqResult < 0) {
-            WRNPRINT("Request IRQ %d failed with return code %d.\n", DP_INT, iIrqResult);
+    //Publish acquisition settings before any S_INT
+    InitializeSettings();
+    //Initialize Spin-Lock for S_INT Event Queue
+    spin_lock_init(&spnlkSIntEventLock);
+    //Initialize S_INT bottom half
+    if (S_INT_BOTTOM_HALF_WORKQUEUE == iSIntBottomHalfMode) {
+        lpSIntWorkqueue = alloc_workqueue(DRIVER_NAME, WQ_HIGHPRI, 1);
+        if (!lpSIntWorkqueue) {
+            WRNPRINT("Failed to create workqueue, S_INT bottom half falls back to threaded IRQ.\n");
+            iSIntBottomHalfMode = S_INT_BOTTOM_HALF_THREADED_IRQ;
         }
     }
-    else {
-        WRNPRINT("Request GPIO %d failed with return code %d.\n", DP_INT_LABEL, iIrqResult);
-    }
-    //Request interrupt PW_INT
-    iIrqResult = gpio_request(PW_INT_LABEL, PW_INT_NAME);
-    if (0 == iIrqResult) {
-        s3c_gpio_cfgpin(PW_INT_LABEL, S3C_GPIO_SFN(0xF));
-        s3c_gpio_setpull(PW_INT_LABEL, S3C_GPIO_PULL_UP);
-        gpio_free(PW_INT_LABEL);
-
-        iIrqResult = request_irq(PW_INT, pw_int_interrupt, IRQ_TYPE_EDGE_FALLING, PW_INT_NAME, NULL);
-        if (iIrqResult < 0) {
-            WRNPRINT("Request IRQ %d failed with return code %d.\n", PW_INT, iIrqResult);
-        }
+    INIT_WORK(&wkSIntBottomHalf, s_int_work);
+#ifdef IS_IRQ_STATISTICS_REQUESTED
+    //Create statistics files in debugfs, the driver works without them
+    lpStatsDebugfsDir = debugfs_create_dir(STATS_DEBUGFS_DIR_NAME, NULL);
+    if (IS_ERR_OR_NULL(lpStatsDebugfsDir)) {
+        WRNPRINT("Failed to create debugfs directory, statistics are not available.\n");
+        lpStatsDebugfsDir = NULL;
     }
     else {
-        WRNPRINT("Request GPIO %d failed with return code %d.\n", PW_INT_LABEL, iIrqResult);
+        debugfs_create_file("histograms", S_IRUGO, lpStatsDebugfsDir, NULL, &interrupt_demo_stats_file_operations);
+        debugfs_create_file("reset", S_IWUSR, lpStatsDebugfsDir, NULL, &interrupt_demo_stats_reset_file_operations);
+        debugfs_create_file("lines", S_IRUGO, lpStatsDebugfsDir, NULL, &interrupt_demo_lines_file_operations);
     }
-    //Request interrupt DAC_INT
-    iIrqResult = gpio_request(DAC_INT_LABEL, DAC_INT_NAME);
-    if (0 == iIrqResult) {
-        s3c_gpio_cfgpin(DAC_INT_LABEL, S3C_GPIO_SFN(0xF));
-        s3c_gpio_setpull(DAC_INT_LABEL, S3C_GPIO_PULL_UP);
-        gpio_free(DAC_INT_LABEL);
-
-        iIrqResult = request_irq(DAC_INT, dac_int_interrupt, IRQ_TYPE_EDGE_FALLING, DAC_INT_NAME, NULL);
-        if (iIrqResult < 0) {
-            WRNPRINT("Request IRQ %d failed with return code %d.\n", DAC_INT, iIrqResult);
-        }
-    }
-    else {
-        WRNPRINT("Request GPIO %d failed with return code %d.\n", DAC_INT_LABEL, iIrqResult);
+#endif
+    //Use request_irq() to register interrupts here
+    if (S_INT_CPU_ANY != iSIntCpu && (iSIntCpu < 0 || iSIntCpu >= nr_cpu_ids || !cpu_online(iSIntCpu))) {
+        WRNPRINT("CPU %d is not online, S_INT is not pinned.\n", iSIntCpu);
+        iSIntCpu = S_INT_CPU_ANY;
     }
+    arrIrqLines[IRQ_LINE_S_INT].lpThreadFunction = S_INT_BOTTOM_HALF_THREADED_IRQ == iSIntBottomHalfMode ? s_int_thread : NULL;
+    arrIrqLines[IRQ_LINE_S_INT].iCpu = iSIntCpu;
 #ifdef IS_GPIO_INTERRUPT_DEBUG
     WRNPRINT("You have enabled on-board GPIO keys\' interrupts. These interrupts need disabling \'GPIO Buttons\' driver in Kernel-Config\'s \'Device Drivers -> Input device support -> Keyboards\' menu to work. If you did so, GPIO keypads may not be available.\n");
-    //Request interrupt KEY_HOME
-    iIrqResult = gpio_request(KEY_HOME_LABEL, KEY_HOME_NAME);
-    if (0 == iIrqResult) {
-        s3c_gpio_cfgpin(KEY_HOME_LABEL, S3C_GPIO_SFN(0xF));
-        s3c_gpio_setpull(KEY_HOME_LABEL, S3C_GPIO_PULL_UP);
-        gpio_free(KEY_HOME_LABEL);
-
-        iIrqResult = request_irq(KEY_HOME, key_home_interrupt, IRQ_TYPE_EDGE_FALLING, KEY_HOME_NAME, NULL);
-        if (iIrqResult < 0) {
-            WRNPRINT("Request IRQ %d failed with return code %d.\n", KEY_HOME, iIrqResult);
-        }
-    }
-    else {
-        WRNPRINT("Request GPIO %d failed with return code %d.\n", KEY_HOME_LABEL, iIrqResult);
-    }
-    //Request interrupt KEY_BACK
-    iIrqResult = gpio_request(KEY_BACK_LABEL, KEY_BACK_NAME);
-    if (0 == iIrqResult) {
-        s3c_gpio_cfgpin(KEY_BACK_LABEL, S3C_GPIO_SFN(0xF));
-        s3c_gpio_setpull(KEY_BACK_LABEL, S3C_GPIO_PULL_UP);
-        gpio_free(KEY_BACK_LABEL);
-
-        iIrqResult = request_irq(KEY_BACK, key_back_interrupt, IRQ_TYPE_EDGE_FALLING, KEY_BACK_NAME, NULL);
-        if (iIrqResult < 0) {
-            WRNPRINT("Request IRQ %d failed with return code %d.\n", KEY_BACK, iIrqResult);
-        }
-    }
-    else {
-        WRNPRINT("Request GPIO %d failed with return code %d.\n", KEY_BACK_LABEL, iIrqResult);
-    }
-    //Request interrupt KEY_SLEEP
-    iIrqResult = gpio_request(KEY_SLEEP_LABEL, KEY_SLEEP_NAME);
-    if (0 == iIrqResult) {
-        s3c_gpio_cfgpin(KEY_SLEEP_LABEL, S3C_GPIO_SFN(0xF));
-        s3c_gpio_setpull(KEY_SLEEP_LABEL, S3C_GPIO_PULL_UP);
-        gpio_free(KEY_SLEEP_LABEL);
-
-        iIrqResult = request_irq(KEY_SLEEP, key_sleep_interrupt, IRQ_TYPE_EDGE_FALLING, KEY_SLEEP_NAME, NULL);
-        if (iIrqResult < 0) {
-            WRNPRINT("Request IRQ %d failed with return code %d.\n", KEY_SLEEP, iIrqResult);
-        }
-    }
-    else {
-        WRNPRINT("Request GPIO %d failed with return code %d.\n", KEY_SLEEP_LABEL, iIrqResult);
-    }
-    //Request interrupt KEY_VOL+
-    iIrqResult = gpio_request(KEY_VOLUP_LABEL, KEY_VOLUP_NAME);
-    if (0 == iIrqResult) {
-        s3c_gpio_cfgpin(KEY_VOLUP_LABEL, S3C_GPIO_SFN(0xF));
-        s3c_gpio_setpull(KEY_VOLUP_LABEL, S3C_GPIO_PULL_UP);
-        gpio_free(KEY_VOLUP_LABEL);
-
-        iIrqResult = request_irq(KEY_VOLUP, key_volup_interrupt, IRQ_TYPE_EDGE_FALLING, KEY_VOLUP_NAME, NULL);
-        if (iIrqResult < 0) {
-            WRNPRINT("Request IRQ %d failed with return code %d.\n", KEY_VOLUP, iIrqResult);
-        }
-    }
-    else {
-        WRNPRINT("Request GPIO %d failed with return code %d.\n", KEY_VOLUP_LABEL, iIrqResult);
-    }
-    //Request interrupt KEY_VOL-
-    iIrqResult = gpio_request(KEY_VOLDOWN_LABEL, KEY_VOLDOWN_NAME);
-    if (0 == iIrqResult) {
-        s3c_gpio_cfgpin(KEY_VOLDOWN_LABEL, S3C_GPIO_SFN(0xF));
-        s3c_gpio_setpull(KEY_VOLDOWN_LABEL, S3C_GPIO_PULL_UP);
-        gpio_free(KEY_VOLDOWN_LABEL);
-
-        iIrqResult = request_irq(KEY_VOLDOWN, key_voldown_interrupt, IRQ_TYPE_EDGE_FALLING, KEY_VOLDOWN_NAME, NULL);
-        if (iIrqResult < 0) {
-            WRNPRINT("Request IRQ %d failed with return code %d.\n", KEY_VOLDOWN, iIrqResult);
-        }
-    }
-    else {
-        WRNPRINT("Request GPIO %d failed with return code %d.\n", KEY_VOLDOWN_LABEL, iIrqResult);
-    }
 #endif
+    unsigned int iLine;
+    for (iLine = 0; iLine < IRQ_LINE_COUNT; ++iLine) {
+        arrIrqLinesByArgument[arrIrqLines[iLine].iArgument] = &arrIrqLines[iLine];
+        RequestDemoIrq(&arrIrqLines[iLine]); //Lines which fail stay unused, the others still work
+    }
     //Create device node
-    clsDevice = class_create(THIS_MODULE, CLASS_NAME);
+    clsDevice = CreateDeviceClass(CLASS_NAME);
     if (IS_ERR(clsDevice)) {
         WRNPRINT("failed in creating device class.\n");
         return 0;
     }
     device_create(clsDevice, NULL, devDeviceNumber, NULL, NODE_NAME);
+    device_create(clsDevice, NULL, MKDEV(iMajorDeviceNumber, MINOR_EVENTS), NULL, EVENTS_NODE_NAME);
+    device_create(clsDevice, NULL, MKDEV(iMajorDeviceNumber, MINOR_PLAYBACK), NULL, PLAYBACK_NODE_NAME);
     return 0;
 }
 
 static void __exit interrupt_demo_exit(void) {
     DBGPRINT("Exiting...\n");
-    device_destroy(clsDevice, MKDEV(iMajorDeviceNumber, 0));
+    device_destroy(clsDevice, MKDEV(iMajorDeviceNumber, MINOR_PLAYBACK));
+    device_destroy(clsDevice, MKDEV(iMajorDeviceNumber, MINOR_EVENTS));
+    device_destroy(clsDevice, MKDEV(iMajorDeviceNumber, MINOR_FRAMES));
     class_destroy(clsDevice);
+    cdev_del(&cdevPlaybackDevice);
+    cdev_del(&cdevEventsDevice);
     cdev_del(&cdevDevice);
-    unregister_chrdev_region(MKDEV(iMajorDeviceNumber, 0), 1);
+    unregister_chrdev_region(MKDEV(iMajorDeviceNumber, MINOR_FRAMES), MINOR_DEVICE_COUNT);
     //Use free_irq() to unregister interrupts here
-    free_irq(S_INT, NULL);
-    free_irq(DP_INT, NULL);
-    free_irq(PW_INT, NULL);
-    free_irq(DAC_INT, NULL);
-#ifdef IS_GPIO_INTERRUPT_DEBUG
-    free_irq(KEY_HOME, NULL);
-    free_irq(KEY_BACK, NULL);
-    free_irq(KEY_SLEEP, NULL);
-    free_irq(KEY_VOLUP, NULL);
-    free_irq(KEY_VOLDOWN, NULL);
+    unsigned int iLine;
+    for (iLine = 0; iLine < IRQ_LINE_COUNT; ++iLine) {
+        FreeDemoIrq(&arrIrqLines[iLine]);
+    }
+#ifdef IS_IRQ_STATISTICS_REQUESTED
+    debugfs_remove_recursive(lpStatsDebugfsDir);
 #endif
+    //S_INT is freed, no more bottom half can be queued
+    if (lpSIntWorkqueue) {
+        destroy_workqueue(lpSIntWorkqueue); //Waits for pending bottom half
+    }
+    FreeWaveformTemplates();
+    FreeSettings();
+    NFOPRINT("S_INT statistics: %lu events, %lu dropped before bottom half, top half residency max %llu ns, average %llu ns.\n", queSIntEventQueue.lTotalEvents, queSIntEventQueue.lTotalDropped, queSIntEventQueue.lMaxResidency, queSIntEventQueue.lTotalEvents ? div64_u64(queSIntEventQueue.lTotalResidency, queSIntEventQueue.lTotalEvents) : 0);
+    NFOPRINT("IRQ Event FIFO statistics: %u records queued, %d dropped.\n", fifIrqEvents.iHead, atomic_read(&fifIrqEvents.iDropped));
+    unsigned int iChannel;
+    FreePlaybackRing(&plbPlayback); //DAC_INT is freed
+    for (iChannel = 0; iChannel < iDataChannelCount; ++iChannel) {
+        FreeDataRing(&arrDataRings[iChannel]);
+    }
     return;
 }
 
@@ -1,20 +1,164 @@
 #ifndef INTERRUPT_DEMO_H
 #define INTERRUPT_DEMO_H
 
+#include <linux/ioctl.h>
+
 /* Name Strings */
 #define DRIVER_NAME "interrupt-demo"
 #define DEVICE_NAME "interrupt-demo"
 #define NODE_NAME   "interrupt-demo"
 #define CLASS_NAME  "interrupt-demo-class"
+#define EVENTS_NODE_NAME "interrupt-demo-events" //Node of IRQ Event FIFO
+#define PLAYBACK_NODE_NAME "interrupt-demo-playback" //Node of Playback Ring
+
+/* Minor Device Numbers */
+#define MINOR_FRAMES       0 //Frame Rings and IO control
+#define MINOR_EVENTS       1 //IRQ Event FIFO
+#define MINOR_PLAYBACK     2 //Playback Ring
+#define MINOR_DEVICE_COUNT 3 //Number of minor device numbers
 
 /* Data Buffer Definitions */
 //Structure of Data Buffer:
 //[Wave(0)][Wave(1)]...[Wave(DATA_BUFFER_WAVE_DATA_SIZE - 1)][ExtraData(0)][ExtraData(1)]...[ExtraData(DATA_BUFFER_EXTRA_DATA_SIZE - 1)]
 #define DATA_BUFFER_WAVE_DATA_SIZE  520 //Size of wave data zone of Data Buffer
-#define DATA_BUFFER_EXTRA_DATA_SIZE 0 //Size of extra data (non-wave data) of Data Buffer
+#define DATA_BUFFER_EXTRA_DATA_SIZE 9 //Size of extra data (non-wave data) of Data Buffer
 #define DATA_BUFFER_SIZE            (DATA_BUFFER_WAVE_DATA_SIZE + DATA_BUFFER_EXTRA_DATA_SIZE) //Data Buffer (to store data and read) size. For consumer programs (e.g. UserApp), its buffer size is better to be the same as DATA_BUFFER_SIZE. Otherwise, a Segmentation Fault may occur.
 #define DATA_MAX_VALUE              10 //Max data value
 #define CONTROL_COMMAND_BUFFER_SIZE 2 //Command Buffer (for write() function) size
+//Structure of Extra Data zone:
+//[Sequence][OverrunCount][TimestampLow][TimestampHigh][WriteSequence][SampleCount][SampleFormat][WaveDataSize][PulseCount]
+#define DATA_EXTRA_SEQUENCE       (DATA_BUFFER_WAVE_DATA_SIZE + 0) //Sequence number of the S_INT which produced this frame, increases monotonically (including dropped frames)
+#define DATA_EXTRA_OVERRUN_COUNT  (DATA_BUFFER_WAVE_DATA_SIZE + 1) //Number of frames dropped right before this frame, because Frame Ring or S_INT Event Queue was full
+#define DATA_EXTRA_TIMESTAMP_LOW  (DATA_BUFFER_WAVE_DATA_SIZE + 2) //Low 32 bits of the time S_INT arrived, in nanoseconds of CLOCK_MONOTONIC
+#define DATA_EXTRA_TIMESTAMP_HIGH (DATA_BUFFER_WAVE_DATA_SIZE + 3) //High 32 bits of the time S_INT arrived
+#define DATA_EXTRA_WRITE_SEQUENCE (DATA_BUFFER_WAVE_DATA_SIZE + 4) //Seqcount of this frame slot, odd while the driver is writing it. A copy is consistent if it was even and unchanged before and after copying
+#define DATA_EXTRA_SAMPLE_COUNT   (DATA_BUFFER_WAVE_DATA_SIZE + 5) //Number of valid samples at the beginning of wave data zone, less than DATA_BUFFER_WAVE_DATA_SIZE when the frame is compressed
+#define DATA_EXTRA_SAMPLE_FORMAT  (DATA_BUFFER_WAVE_DATA_SIZE + 6) //Format of samples in wave data zone, one of CTL_ARG_SAMPLE_FORMAT_*
+#define DATA_EXTRA_WAVE_DATA_SIZE (DATA_BUFFER_WAVE_DATA_SIZE + 7) //Number of valid Bytes at the beginning of wave data zone, only these Bytes are copied by read()
+#define DATA_EXTRA_PULSE_COUNT    (DATA_BUFFER_WAVE_DATA_SIZE + 8) //Pulses found in this frame, see Pulse Extraction Definitions. 0 when pulse extraction is off
+
+/* Channel Definitions */
+//Each S_INT acquires one frame per channel, every channel has its own gain and its own Frame Ring
+#define DATA_CHANNEL_MAX_COUNT   4 //Max number of channels, the number in use is set by module parameter iDataChannelCount
+#define DATA_GAIN_FRACTION_BITS  4 //Gain is a fixed-point number set by CTL_CMD_SET_GAIN, in 1/16
+#define DATA_GAIN_UNITY          (1 << DATA_GAIN_FRACTION_BITS) //Gain 1.0, default
+#define DATA_GAIN_MAX            0xFF //Largest gain (15.9375), larger gains are rejected with -EINVAL
+//When all channels are read at once (CTL_ARG_CHANNEL_ALL), the user space data buffer holds iDataChannelCount frames in one of the following layouts:
+//Planar:      [Frame of channel 0][Frame of channel 1]...[Frame of channel (iDataChannelCount - 1)]
+//Interleaved: [Wave(0) of channel 0][Wave(0) of channel 1]...[Wave(DATA_BUFFER_WAVE_DATA_SIZE - 1) of channel (iDataChannelCount - 1)][ExtraData zone of channel 0]...[ExtraData zone of channel (iDataChannelCount - 1)]
+
+/* Waveform Definitions */
+//Samples are generated from a waveform template plus noise in [0, DATA_MAX_VALUE). Template 0 is built in (arrDataDef), the others are loaded by CTL_IOC_LOAD_TEMPLATE
+#define WAVEFORM_TEMPLATE_COUNT   4 //Number of template slots
+#define WAVEFORM_TEMPLATE_BUILTIN 0 //Slot of the built-in template, it can't be replaced
+#define WAVEFORM_TEMPLATE_MAX_SAMPLE 0xFFFF //Largest sample of a loaded template, keeps (sample + noise) * gain and the sums of compression and pulse extraction within 32 bits
+
+/* Compression Definitions */
+//Each output sample merges CompressCount wave data points, the next output sample starts CompressStep points later
+//CompressStep is a fixed-point number: its integer part is set by CTL_CMD_SET_COMPRESS_STEP_INT_PART and its decimal part (in 1/256) by CTL_CMD_SET_COMPRESS_STEP_FLOAT_PART
+//CompressStep 0 means the same as CompressCount, CompressCount 0 or 1 with CompressStep 0 or 1 disables compression
+#define COMPRESS_STEP_FRACTION_BITS 8 //Number of decimal bits of CompressStep
+
+/* Pulse Extraction Definitions */
+//When CTL_CMD_SET_PULSE_MODE isn't CTL_ARG_PULSE_MODE_OFF, the S_INT bottom half looks for pulses in the samples of each frame, after gain and before compression.
+//A pulse is a run of samples above (Baseline + Threshold), set by CTL_CMD_SET_PULSE_BASELINE and CTL_CMD_SET_PULSE_THRESHOLD.
+//The pulse list is an array of struct interrupt_demo_pulse at the end of the valid Bytes of wave data zone:
+//it starts at Byte (DATA_EXTRA_WAVE_DATA_SIZE - PULSE_COUNT_STORED(DATA_EXTRA_PULSE_COUNT) * sizeof(struct interrupt_demo_pulse)).
+//Pulses which don't fit in wave data zone (e.g. after CTL_ARG_SAMPLE_FORMAT_U32 samples in CTL_ARG_PULSE_MODE_APPEND) or exceed PULSE_MAX_COUNT are counted but not stored.
+#define PULSE_MAX_COUNT                32 //Max number of pulses stored per frame
+#define PULSE_DEFAULT_BASELINE         10 //Default Baseline, the flat part of arrDataDef
+#define PULSE_DEFAULT_THRESHOLD        20 //Default Threshold, above the noise of the synthetic waveform
+#define PULSE_COUNT_STORED(iValue)     ((iValue) & 0xFFFF) //Pulses in the pulse list, from DATA_EXTRA_PULSE_COUNT
+#define PULSE_COUNT_DETECTED(iValue)   ((iValue) >> 16) //Pulses found, from DATA_EXTRA_PULSE_COUNT
+
+struct interrupt_demo_pulse {
+    unsigned short iStart; //Index of the first sample above the threshold
+    unsigned short iWidth; //Number of samples above the threshold
+    unsigned short iPeakPosition; //Index of the highest sample
+    unsigned short iReserved; //0
+    unsigned int iAmplitude; //Highest sample minus Baseline
+    unsigned int iArea; //Sum of (sample - Baseline) over the pulse
+};
+
+/* Trigger Definitions */
+//When CTL_CMD_SET_TRIGGER_MODE isn't CTL_ARG_TRIGGER_MODE_OFF, an S_INT only publishes frames if the samples of the trigger source channel (CTL_CMD_SET_TRIGGER_CHANNEL) meet the trigger.
+//Samples are compared with Level (CTL_CMD_SET_TRIGGER_LEVEL) after gain, edges are also detected across the boundary of two frames.
+//A trigger publishes a window: up to PreFrames frames before the trigger frame, the trigger frame, then PostFrames frames after it, on every channel.
+//Triggers are ignored while the window is open and during Holdoff frames after it. Frames outside windows are rejected: they never enter Frame Ring,
+//they're counted in iRejectedFrames of Control Page and aren't reported in DATA_EXTRA_OVERRUN_COUNT. DATA_EXTRA_SEQUENCE still tells where a window starts.
+#define TRIGGER_HISTORY_DEPTH   8 //Number of frames kept per channel until the trigger decides, must be a power of 2
+#define TRIGGER_MAX_PRE_FRAMES  (TRIGGER_HISTORY_DEPTH - 1) //Max PreFrames, the trigger frame itself takes a slot
+#define TRIGGER_DEFAULT_LEVEL   (PULSE_DEFAULT_BASELINE + PULSE_DEFAULT_THRESHOLD) //Default Level, the same as the default pulse level
+
+/* Frame Ring Definitions */
+//Each S_INT produces a frame (a whole Data Buffer) into the Frame Ring, interrupt_demo_read() consumes the oldest one
+//Every open file of the device has its own read cursor, so several read() consumers get every frame at their own pace, and each frame is stored once for all of them.
+//read() consumers are independent in both modes: a consumer which falls more than iDepth frames behind skips the frames it lost and counts them (see CTL_IOC_GET_READER_STATS), so a slow or idle consumer never holds back the others.
+//In DATA_RING_OVERFLOW_DROP_NEWEST mode, iTail follows the fastest read() consumer, so new frames are only dropped when even the fastest one is a whole ring behind.
+//In DATA_RING_OVERFLOW_OVERWRITE_OLDEST mode, new frames are never dropped, the producer reclaims the oldest frame instead.
+#define DATA_RING_DEFAULT_DEPTH 16 //Default number of frames in Frame Ring, can be changed by module parameter iDataRingDepth
+#define DATA_RING_MIN_DEPTH     2 //Min number of frames in Frame Ring
+#define DATA_RING_MAX_DEPTH     1024 //Max number of frames in Frame Ring
+//What the producer does when Frame Ring is full, selected by module parameter iDataRingOverflowMode or CTL_CMD_SET_OVERFLOW_MODE
+#define DATA_RING_OVERFLOW_DROP_NEWEST      0 //Drop the new frame, consumers get every frame they don't lose in order (default)
+#define DATA_RING_OVERFLOW_OVERWRITE_OLDEST 1 //Reclaim the oldest unread frame, consumers always get the latest frames
+
+/* Wakeup Definitions */
+//read(), poll() and epoll report an open file readable when the current channel (every channel, for CTL_ARG_CHANNEL_ALL) has an unread frame and either:
+//it has CTL_CMD_SET_WAKEUP_THRESHOLD unread frames, or its oldest unread frame arrived CTL_CMD_SET_WAKEUP_TIMEOUT microseconds ago, whichever comes first.
+//Batch consumers raise the threshold and bound their latency with the timeout, low-latency consumers keep the threshold at 1.
+//With CTL_ARG_WAKEUP_ALIGN_DP_INT, the policy is only checked at DP_INT ticks, so aligned consumers wake up together at most once per tick. They never wake up while DP_INT is disabled.
+
+/* S_INT Bottom Half Definitions */
+//S_INT handler is split into a top half (timestamps the event and queues it) and a bottom half (fills and publishes the frame)
+//The bottom half is selected by module parameter iSIntBottomHalfMode
+#define S_INT_BOTTOM_HALF_NONE         0 //Run the bottom half in hard IRQ context right after the top half, like older versions of this driver
+#define S_INT_BOTTOM_HALF_THREADED_IRQ 1 //Run the bottom half in the IRQ thread (request_threaded_irq()), default
+#define S_INT_BOTTOM_HALF_WORKQUEUE    2 //Run the bottom half in a high priority workqueue
+#define S_INT_EVENT_QUEUE_DEPTH        32 //Number of S_INT events that can wait for the bottom half, must be a power of 2
+//Module parameter iSIntCpu pins S_INT and its bottom half to a CPU, so the frames and the producer's state stay in the cache of that CPU. Consumers are better run on other CPUs.
+#define S_INT_CPU_ANY                  -1 //Don't pin S_INT, default
+
+/* Statistics Definitions */
+//Histograms are log2 of nanoseconds: bucket n counts values in [2^(n-1), 2^n), bucket 0 counts 0, the last bucket also counts everything larger
+#define STATS_HISTOGRAM_BUCKETS 32 //Up to about 2 seconds
+#define STATS_IRQ_S_INT         0 //Index of S_INT statistics
+#define STATS_IRQ_DP_INT        1 //Index of DP_INT statistics
+#define STATS_IRQ_PW_INT        2 //Index of PW_INT statistics
+#define STATS_IRQ_DAC_INT       3 //Index of DAC_INT statistics
+#define STATS_IRQ_COUNT         4 //Number of IRQs with statistics
+#define STATS_DEBUGFS_DIR_NAME  DRIVER_NAME //Statistics are in /sys/kernel/debug/interrupt-demo/, write anything to "reset" to clear them
+
+/* Memory Map Definitions */
+//mmap() exposes Frame Ring to user space without copying. Map the whole area from offset 0, its layout is:
+//[Control Page][Frame(0)][Frame(1)]...[Frame(iDepth - 1)]
+//Every channel has its own area, the area of channel n is mapped from offset (n * iMapSize).
+//A consumer reads iHead, issues a read barrier, then for the frame at iTail:
+//  reads its WriteSequence (retry if odd), issues a read barrier, reads the frame in place, issues a read barrier, rereads WriteSequence (the frame is torn if it changed),
+//  then advances iTail with compare-and-swap from the old value. If the swap fails, the driver has reclaimed the frame (DATA_RING_OVERFLOW_OVERWRITE_OLDEST), just reload iTail.
+//Frame(n) is at (iFrameOffset + (n & (iDepth - 1)) * iFrameSize) Bytes from the beginning of the mapping.
+//Don't mix read() and mmap() consumers on the same device, read() consumers advance iTail to their fastest cursor.
+//Fields of Control Page are grouped by writer, each group in its own cache line, so the producer CPU and consumer CPUs don't bounce a line they don't both write.
+#define DATA_RING_CONTROL_LINE_SIZE 64 //Size of a group, at least the cache line size of the CPU (32 Bytes on Cortex-A9)
+#define DATA_RING_CONTROL_PADDING(iFieldCount) (DATA_RING_CONTROL_LINE_SIZE / sizeof(unsigned int) - (iFieldCount))
+struct interrupt_demo_ring_control {
+    //Read mostly
+    unsigned int iDepth; //Number of frames, a power of 2
+    unsigned int iFrameSize; //Size of a frame in Bytes
+    unsigned int iFrameOffset; //Offset of Frame(0) in Bytes from the beginning of the mapping
+    unsigned int iMapSize; //Size of the whole mapping in Bytes
+    unsigned int iOverflowMode; //Current DATA_RING_OVERFLOW_* mode
+    unsigned int iChannel; //Channel of this Frame Ring
+    unsigned int iChannelCount; //Number of channels in use
+    unsigned int arrReserved0[DATA_RING_CONTROL_PADDING(7)];
+    //Written by the producer
+    unsigned int iHead; //Producer counter, free-running, written by the driver only
+    unsigned int iRejectedFrames; //Frames of this channel rejected by trigger mode, free-running
+    unsigned int arrReserved1[DATA_RING_CONTROL_PADDING(2)];
+    //Written by consumers
+    unsigned int iTail; //Consumer counter, free-running, written by the consumer after a frame is consumed (the fastest open file for read() consumers)
+    unsigned int arrReserved2[DATA_RING_CONTROL_PADDING(1)];
+};
 
 /* Information Printing Functions */
 //DBGPRINT() is used to print debug messages, comment #define IS_IN_DEBUG to disable them
@@ -29,8 +173,20 @@
 #define WRNPRINT(sInfo...) printk(KERN_WARNING "InterruptDemo - Warning: " sInfo)
 #define ERRPRINT(sInfo...) printk(KERN_ERR "InterruptDemo - Error: " sInfo)
 
+/* Interrupt Source */
+//Interrupts come from Exynos-4412 GPIOs. On other platforms (e.g. an x86 PC), or when built with "make SIMULATED=1", they are generated by hrtimers instead,
+//at the rates set by module parameter arrSimulatedIrqRates, and drive the same interrupt handlers. On-board keys are not simulated.
+#if !defined(CONFIG_ARCH_EXYNOS4) && !defined(IS_SIMULATED_INTERRUPT_SOURCE)
+#define IS_SIMULATED_INTERRUPT_SOURCE
+#endif
+#define SIMULATED_IRQ_COUNT         4 //S_INT, DP_INT, PW_INT and DAC_INT
+#define SIMULATED_IRQ_MAX_RATE      1000000 //Max rate of a simulated interrupt, in Hz
+
 /* Interrupt Names */
 #define IS_GPIO_INTERRUPT_DEBUG //Comment this when using GPIO keypad
+#ifdef IS_SIMULATED_INTERRUPT_SOURCE
+#undef IS_GPIO_INTERRUPT_DEBUG
+#endif
 #define S_INT_NAME              "S_INT__XEINT1_BAK__XEINT1"
 #define XEINT20_NAME            "DP_INT__XEINT20_BAK__XEINT20"
 #define PW_INT_NAME             "PW_INT__GM_INT2__XEINT25"
@@ -44,6 +200,13 @@
 #endif
 
 /* Interrupt IDs and Labels */
+#ifdef IS_SIMULATED_INTERRUPT_SOURCE
+//Indexes of simulated interrupt sources
+#define S_INT   0
+#define DP_INT  1
+#define PW_INT  2
+#define DAC_INT 3
+#else
 //S_INT__XEINT1_BAK__XEINT1
 #define S_INT_LABEL EXYNOS4_GPX0(1)
 #define S_INT       IRQ_EINT(1)
@@ -73,6 +236,29 @@
 #define KEY_VOLDOWN_LABEL EXYNOS4_GPX2(0)
 #define KEY_VOLDOWN       IRQ_EINT(16)
 #endif
+#endif
+
+/* IRQ Line Definitions */
+//Every interrupt is described by an entry of the IRQ line table, which drives registration, teardown and CTL_CMD_DISABLE_IRQ/CTL_CMD_ENABLE_IRQ
+#define IRQ_LINE_S_INT       0
+#define IRQ_LINE_DP_INT      1
+#define IRQ_LINE_PW_INT      2
+#define IRQ_LINE_DAC_INT     3
+#ifdef IS_GPIO_INTERRUPT_DEBUG
+#define IRQ_LINE_KEY_HOME    4
+#define IRQ_LINE_KEY_BACK    5
+#define IRQ_LINE_KEY_SLEEP   6
+#define IRQ_LINE_KEY_VOLUP   7
+#define IRQ_LINE_KEY_VOLDOWN 8
+#define IRQ_LINE_COUNT       9 //Number of IRQ lines
+#else
+#define IRQ_LINE_COUNT       4 //Number of IRQ lines
+#endif
+//GPIO keys are debounced: a key line is masked on an interrupt, then unmasked by an hrtimer after the debounce time.
+//Auxiliary lines (PW_INT and GPIO keys) are protected from IRQ storms: a line exceeding the storm limit within a second is masked for IRQ_STORM_BACKOFF_TIME, and reported.
+#define IRQ_DEFAULT_DEBOUNCE_TIME 20000 //Default debounce time of GPIO keys in microseconds, module parameter iKeyDebounceTime
+#define IRQ_DEFAULT_STORM_LIMIT   1000 //Default storm limit in interrupts per second, module parameter iIrqStormLimit
+#define IRQ_STORM_BACKOFF_TIME    1000 //Milliseconds a line stays masked after an IRQ storm
 
 /* Control Commands */
 //Control commands are defined in CTL_CMD_ format
@@ -107,8 +293,8 @@
 #define CTL_CMD_SET_COMPRESS_COUNT_LOW_BYTE  0x07 //Set Compress Count (How many points are merged), Low Byte
 #define CTL_CMD_SET_COMPRESS_STEP_INT_PART   0x08 //Set Compress Step's integer part
 #define CTL_CMD_SET_COMPRESS_STEP_FLOAT_PART 0x09 //Set Compress Step's decimal part
-#define CTL_CMD_SET_GAIN                     0x0a //Set Gain
-#define CTL_CMD_SET_CHANNEL                  0x0c //Set Channel
+#define CTL_CMD_SET_GAIN                     0x0a //Set Gain of the current channel, in 1/16 (0 to DATA_GAIN_MAX)
+#define CTL_CMD_SET_CHANNEL                  0x0c //Set Channel, it selects the channel read() consumes and CTL_CMD_SET_GAIN applies to
 #define CTL_CMD_RESERVED_12                  0x12 //Reserved
 #define CTL_CMD_RESERVED_14                  0x14 //Reserved
 #define CTL_CMD_RESERVED_16                  0x16 //Reserved
@@ -116,6 +302,29 @@
 #define CTL_CMD_RESERVED_1A                  0x1a //Reserved
 #define CTL_CMD_RESERVED_1C                  0x1c //Reserved
 #define CTL_CMD_RESERVED_1E                  0x1e //Reserved
+#define CTL_CMD_TRIGGER_S_INT                0x20 //Trigger S_INT by software, the argument is the number of S_INTs to trigger (0 means 1, at most CTL_ARG_TRIGGER_S_INT_MAX_COUNT)
+#define CTL_CMD_SET_OVERFLOW_MODE            0x21 //Set what to do when Frame Ring is full, the argument is one of DATA_RING_OVERFLOW_*
+#define CTL_CMD_SET_COMPRESS_MODE            0x22 //Set how points are merged by compression, the argument is one of CTL_ARG_COMPRESS_MODE_*
+#define CTL_CMD_SET_CHANNEL_LAYOUT           0x23 //Set how read() arranges frames of all channels, the argument is one of CTL_ARG_CHANNEL_LAYOUT_*
+#define CTL_CMD_SET_DELAY                    0x24 //Set Delay, the argument is the whole 16-bit value
+#define CTL_CMD_SET_COMPRESS_COUNT           0x25 //Set Compress Count, the argument is the whole 16-bit value
+#define CTL_CMD_SET_COMPRESS_STEP            0x26 //Set Compress Step, the argument is the whole 16-bit fixed-point value (integer part in the high byte)
+#define CTL_CMD_SET_SAMPLE_FORMAT            0x27 //Set the format of samples in wave data zone of new frames, the argument is one of CTL_ARG_SAMPLE_FORMAT_*
+#define CTL_CMD_SET_READ_MODE                0x28 //Set what read() returns, the argument is one of CTL_ARG_READ_MODE_*
+#define CTL_CMD_SET_TEMPLATE                 0x29 //Select the waveform template of new frames, the argument is a loaded template slot
+#define CTL_CMD_SET_WAKEUP_THRESHOLD         0x2a //Set the number of unread frames which make this open file readable (1 to iDepth), it only applies to the file it's issued on
+#define CTL_CMD_SET_PULSE_MODE               0x2b //Set whether frames carry samples, pulses or both, the argument is one of CTL_ARG_PULSE_MODE_*
+#define CTL_CMD_SET_PULSE_BASELINE           0x2c //Set Baseline of pulse extraction, the argument is a 16-bit sample value
+#define CTL_CMD_SET_PULSE_THRESHOLD          0x2d //Set Threshold of pulse extraction above Baseline, the argument is a 16-bit sample value
+#define CTL_CMD_SET_TRIGGER_MODE             0x2e //Set which frames are published, the argument is one of CTL_ARG_TRIGGER_MODE_*
+#define CTL_CMD_SET_TRIGGER_LEVEL            0x2f //Set Level of the trigger, the argument is a 16-bit sample value
+#define CTL_CMD_SET_TRIGGER_CHANNEL          0x30 //Set the trigger source channel
+#define CTL_CMD_SET_TRIGGER_PRE_FRAMES       0x31 //Set the number of frames published before the trigger frame (0 to TRIGGER_MAX_PRE_FRAMES)
+#define CTL_CMD_SET_TRIGGER_POST_FRAMES      0x32 //Set the number of frames published after the trigger frame, the argument is the whole 16-bit value
+#define CTL_CMD_SET_TRIGGER_HOLDOFF          0x33 //Set the number of frames after a window during which triggers are ignored, the argument is the whole 16-bit value
+#define CTL_CMD_SET_WAKEUP_TIMEOUT           0x34 //Set how long the oldest unread frame may wait before this open file is readable anyway, in microseconds (0 disables), it only applies to the file it's issued on
+#define CTL_CMD_SET_WAKEUP_ALIGN             0x35 //Set whether this open file is woken up at DP_INT ticks only, the argument is one of CTL_ARG_WAKEUP_ALIGN_*, it only applies to the file it's issued on
+#define CTL_CMD_SET_PLAYBACK_WATERMARK       0x36 //Set the number of queued blocks at or below which Playback Ring writers are woken up (0 to iDepth - 1)
 
 /* Control Arguments */
 //Arguments are defined in CTL_ARG_ format
@@ -131,10 +340,180 @@
 #define CTL_ARG_IRQ_NAME_KEY_VOLUP   0x14
 #define CTL_ARG_IRQ_NAME_KEY_VOLDOWN 0x15
 #endif
+#define CTL_ARG_IRQ_NAME_MAX     0x15 //Largest CTL_ARG_IRQ_NAME_*, other arguments select S_INT
+#define CTL_ARG_TRIGGER_S_INT_MAX_COUNT    0x10000 //CTL_CMD_TRIGGER_S_INT: largest number of S_INTs per command, larger counts are rejected by CTL_IOC and clamped by the legacy interfaces
+#define CTL_ARG_CHANNEL_ALL                0xFF //CTL_CMD_SET_CHANNEL: read() returns a frame of every channel at once
+#define CTL_ARG_CHANNEL_LAYOUT_PLANAR      0x00 //Frames of all channels one after another
+#define CTL_ARG_CHANNEL_LAYOUT_INTERLEAVED 0x01 //Samples of all channels interleaved
+#define CTL_ARG_COMPRESS_MODE_MEAN 0x00 //Output the mean of merged points
+#define CTL_ARG_COMPRESS_MODE_MIN  0x01 //Output the min of merged points
+#define CTL_ARG_COMPRESS_MODE_MAX  0x02 //Output the max of merged points
+//Sample formats, encoders and decoders are in SampleFormats.h. Frames are encoded when they are published, the interleaved channel layout always transfers 32-bit samples.
+#define CTL_ARG_SAMPLE_FORMAT_U32          0x00 //unsigned int per sample (default)
+#define CTL_ARG_SAMPLE_FORMAT_U16          0x01 //unsigned short per sample
+#define CTL_ARG_SAMPLE_FORMAT_DELTA_VARINT 0x02 //Zigzag varint of the difference from the previous sample. A frame which doesn't fit is published in CTL_ARG_SAMPLE_FORMAT_U32 instead
+#define CTL_ARG_READ_MODE_SINGLE_FRAME     0x00 //One Data Buffer per read(), returns the number of Bytes of the user space data buffer it occupies, or -EFAULT (default, for old user applications). Older versions returned the number of Bytes NOT copied, i.e. 0 on success: check for a negative result instead of a non-zero one
+#define CTL_ARG_READ_MODE_BATCH            0x01 //As many frame records as fit per read(), returns the number of Bytes copied (see Batched Read Definitions)
+#define CTL_ARG_PULSE_MODE_OFF             0x00 //Samples only (default)
+#define CTL_ARG_PULSE_MODE_EVENTS          0x01 //Pulse list only, DATA_EXTRA_SAMPLE_COUNT is 0
+#define CTL_ARG_PULSE_MODE_APPEND          0x02 //Samples followed by the pulse list
+#define CTL_ARG_TRIGGER_MODE_OFF           0x00 //Every frame is published (default)
+#define CTL_ARG_TRIGGER_MODE_LEVEL         0x01 //Trigger on any sample at or above Level
+#define CTL_ARG_TRIGGER_MODE_RISING        0x02 //Trigger when a sample reaches Level from below
+#define CTL_ARG_TRIGGER_MODE_FALLING       0x03 //Trigger when a sample drops below Level
+#define CTL_ARG_WAKEUP_ALIGN_NONE          0x00 //Readable as soon as the wakeup policy is met (default)
+#define CTL_ARG_WAKEUP_ALIGN_DP_INT        0x01 //The wakeup policy is checked against frames published before the last DP_INT tick and the time of that tick
+
+/* Batched Read Definitions */
+//In CTL_ARG_READ_MODE_BATCH, read() fills the user space data buffer with as many complete frame records as fit and returns their total size:
+//[Record(0)][Record(1)]...[Record(n - 1)]
+//Record: [struct interrupt_demo_frame_header][Wave data zone, iDataSize Bytes][Padding to iRecordSize]
+//It blocks (or returns -EAGAIN) until at least one frame is available, and returns -EINVAL if the buffer can't hold the oldest frame's record.
+//With CTL_ARG_CHANNEL_ALL, channels are drained in turns and each record tells its channel.
+//splice() and sendfile() from the device always move frame records, in any read mode, so a recorder can stream them to a file or a socket without touching them.
+#define FRAME_RECORD_ALIGNMENT 8 //Records start at multiples of 8 Bytes
+#define FRAME_RECORD_MAX_SIZE  (sizeof(struct interrupt_demo_frame_header) + DATA_BUFFER_WAVE_DATA_SIZE * sizeof(unsigned int)) //A user space data buffer of this size always holds a record
+
+struct interrupt_demo_frame_header {
+    unsigned int iRecordSize; //Size of this record in Bytes, the next record starts right after it
+    unsigned int iDataSize; //Size of wave data following this header in Bytes
+    unsigned int iSequence; //Sequence number of S_INT, same as DATA_EXTRA_SEQUENCE
+    unsigned int iOverrunCount; //Same as DATA_EXTRA_OVERRUN_COUNT
+    unsigned long long lTimestamp; //Time S_INT arrived, in nanoseconds of CLOCK_MONOTONIC
+    unsigned int iChannel; //Channel of this frame
+    unsigned int iSampleCount; //Same as DATA_EXTRA_SAMPLE_COUNT
+    unsigned int iSampleFormat; //Same as DATA_EXTRA_SAMPLE_FORMAT
+    unsigned int iPulseCount; //Same as DATA_EXTRA_PULSE_COUNT, the pulse list is at the end of wave data
+};
+
+/* IRQ Event FIFO Definitions */
+//Every PW_INT, DAC_INT and GPIO key interrupt is queued as a record in IRQ Event FIFO, which is read from the second minor device (EVENTS_NODE_NAME).
+//read() returns as many whole records as fit and their total size, it blocks (or returns -EAGAIN) until there is at least one record, and returns -EINVAL if the buffer can't hold a record.
+//When the FIFO is full, new records are dropped. A dropped record shows up as a gap of iSequence of its line.
+#define IRQ_EVENT_FIFO_DEPTH 256 //Number of records, must be a power of 2
+
+struct interrupt_demo_irq_event {
+    unsigned int iLine; //CTL_ARG_IRQ_NAME_* of the interrupt
+    unsigned int iSequence; //Number of interrupts of this line before this one, since the module is loaded
+    unsigned long long lTimestamp; //Time the interrupt arrived, in nanoseconds of CLOCK_MONOTONIC
+};
+
+/* Playback Definitions */
+//The third minor device (PLAYBACK_NODE_NAME) is the output direction: blocks of samples queued into Playback Ring are played by the DAC, one block per DAC_INT.
+//Playback is double-buffered: each DAC_INT hands the converter the block pre-filled by the previous DAC_INT, then copies the next block out of Playback Ring into the other buffer.
+//So a writer only has to keep the ring from running dry, it never has to meet the deadline of a single DAC_INT.
+//When the ring is empty, the converter holds the last sample played, and each DAC_INT without a block is counted as an underrun while the device is open for writing.
+//Only one file may have the device open for writing (-EBUSY otherwise), files opened read-only may still read statistics.
+//write() takes whole blocks only and returns the Bytes of the blocks queued, -EINVAL if the buffer can't hold a block. When the ring is full, it blocks (or returns -EAGAIN)
+//until the ring has drained to the low watermark (CTL_CMD_SET_PLAYBACK_WATERMARK). poll() reports the device writable at the same point, so a writer wakes up once per refill, not once per DAC_INT.
+//mmap() maps Playback Ring like Frame Ring, with the roles swapped: [Control Page][Block(0)][Block(1)]...[Block(iDepth - 1)]. Map the whole area from offset 0.
+//A producer fills Block(iHead & (iDepth - 1)) while (iHead - iTail) < iDepth, issues a write barrier, then advances iHead. The driver advances iTail once it has copied a block out.
+//Don't mix write() and mmap() producers.
+#define PLAYBACK_BLOCK_SAMPLES        256 //Number of samples in a block, each sample is an unsigned int like wave data
+#define PLAYBACK_RING_DEFAULT_DEPTH   32 //Default number of blocks in Playback Ring, can be changed by module parameter iPlaybackRingDepth
+#define PLAYBACK_RING_MIN_DEPTH       4 //Min number of blocks in Playback Ring
+#define PLAYBACK_RING_MAX_DEPTH       1024 //Max number of blocks in Playback Ring
+#define PLAYBACK_DEFAULT_LOW_WATERMARK (PLAYBACK_RING_DEFAULT_DEPTH / 4) //Default low watermark in blocks, clamped below the depth
+
+struct interrupt_demo_playback_control {
+    //Read mostly
+    unsigned int iDepth; //Number of blocks, a power of 2
+    unsigned int iBlockSize; //Size of a block in Bytes
+    unsigned int iBlockOffset; //Offset of Block(0) in Bytes from the beginning of the mapping
+    unsigned int iMapSize; //Size of the whole mapping in Bytes
+    unsigned int iLowWatermark; //Writers are woken up when this many blocks or less are queued, set by CTL_CMD_SET_PLAYBACK_WATERMARK
+    unsigned int arrReserved0[DATA_RING_CONTROL_PADDING(5)];
+    //Written by the producer
+    unsigned int iHead; //Producer counter, free-running, written by the producer after a block is filled
+    unsigned int arrReserved1[DATA_RING_CONTROL_PADDING(1)];
+    //Written by the driver
+    unsigned int iTail; //Consumer counter, free-running, written by DAC_INT after a block is copied out
+    unsigned int iUnderruns; //DAC_INTs which found the ring empty while the device was open for writing, free-running
+    unsigned int arrReserved2[DATA_RING_CONTROL_PADDING(2)];
+};
+
+/* Typed IOControl Definitions */
+//Every CTL_CMD_* command is also available as a typed ioctl() request CTL_IOC(CTL_CMD_*), whose argument points to an unsigned int.
+//CTL_IOC_BATCH applies up to CTL_BATCH_MAX_COUNT {command, argument} pairs in one syscall. The batch is checked as a whole first and applied under one lock, so either all commands are applied or none (-EINVAL).
+//CTL_IOC_GET_CONFIG reads back the current configuration. CTL_IOC_GET_READER_STATS reads back the state of the open file it's issued on.
+//CTL_IOC_GET_PLAYBACK_STATS reads back the state of Playback Ring, it's issued on PLAYBACK_NODE_NAME. CTL_IOC(CTL_CMD_SET_PLAYBACK_WATERMARK) is also accepted there.
+//Raw command numbers (ioctl(fd, CTL_CMD_*, argument)) and 2-Byte write() are still accepted for old user applications.
+#define CTL_IOC_MAGIC       'i' //Type field of typed ioctl() requests
+#define CTL_BATCH_MAX_COUNT 64 //Max number of commands in a batch
+#define CTL_IOC(iCommand)   _IOW(CTL_IOC_MAGIC, (iCommand), unsigned int)
+#define CTL_IOC_BATCH       _IOW(CTL_IOC_MAGIC, 0x80, struct interrupt_demo_command_batch)
+#define CTL_IOC_GET_CONFIG  _IOR(CTL_IOC_MAGIC, 0x81, struct interrupt_demo_config)
+#define CTL_IOC_LOAD_TEMPLATE _IOW(CTL_IOC_MAGIC, 0x82, struct interrupt_demo_template_load) //Load (or replace) a waveform template, it can be selected by CTL_CMD_SET_TEMPLATE
+#define CTL_IOC_GET_READER_STATS _IOR(CTL_IOC_MAGIC, 0x83, struct interrupt_demo_reader_stats)
+#define CTL_IOC_GET_PLAYBACK_STATS _IOR(CTL_IOC_MAGIC, 0x84, struct interrupt_demo_playback_stats)
+
+struct interrupt_demo_command {
+    unsigned int iCommand; //One of CTL_CMD_*
+    unsigned int iArgument; //Argument of the command
+};
+
+struct interrupt_demo_command_batch {
+    unsigned int iCount; //Number of commands
+    unsigned int iReserved; //Must be 0, keeps lpCommands aligned for 32-bit and 64-bit user applications
+    unsigned long long lpCommands; //User space address of an array of iCount struct interrupt_demo_command
+};
+
+struct interrupt_demo_template_load {
+    unsigned int iSlot; //Template slot, 1 to (WAVEFORM_TEMPLATE_COUNT - 1)
+    unsigned int iCount; //Number of samples, 1 to DATA_BUFFER_WAVE_DATA_SIZE. Shorter templates are repeated to fill the frame
+    unsigned long long lpSamples; //User space address of an array of iCount unsigned int, each 0 to WAVEFORM_TEMPLATE_MAX_SAMPLE (-EINVAL otherwise)
+};
+
+struct interrupt_demo_config {
+    unsigned int iChannelCount; //Number of channels in use
+    unsigned int iChannel; //Current channel, or CTL_ARG_CHANNEL_ALL
+    unsigned int iChannelLayout; //One of CTL_ARG_CHANNEL_LAYOUT_*
+    unsigned int arrGains[DATA_CHANNEL_MAX_COUNT]; //Gain of each channel, in 1/16
+    unsigned int iDelay; //Delay
+    unsigned int iCompressCount; //Compress Count
+    unsigned int iCompressStep; //Compress Step, fixed-point with COMPRESS_STEP_FRACTION_BITS decimal bits
+    unsigned int iCompressMode; //One of CTL_ARG_COMPRESS_MODE_*
+    unsigned int iOverflowMode; //One of DATA_RING_OVERFLOW_*
+    unsigned int iSampleFormat; //One of CTL_ARG_SAMPLE_FORMAT_*
+    unsigned int iReadMode; //One of CTL_ARG_READ_MODE_*
+    unsigned int iTemplate; //Current waveform template slot
+    unsigned int iPulseMode; //One of CTL_ARG_PULSE_MODE_*
+    unsigned int iPulseBaseline; //Baseline of pulse extraction
+    unsigned int iPulseThreshold; //Threshold of pulse extraction above Baseline
+    unsigned int iTriggerMode; //One of CTL_ARG_TRIGGER_MODE_*
+    unsigned int iTriggerLevel; //Level of the trigger
+    unsigned int iTriggerChannel; //Trigger source channel
+    unsigned int iTriggerPreFrames; //Frames published before the trigger frame
+    unsigned int iTriggerPostFrames; //Frames published after the trigger frame
+    unsigned int iTriggerHoldoff; //Frames after a window during which triggers are ignored
+};
+
+struct interrupt_demo_reader_stats {
+    unsigned long long lDroppedFrames; //Frames this open file lost because they were overwritten before it read them
+    unsigned int iWakeupThreshold; //Set by CTL_CMD_SET_WAKEUP_THRESHOLD
+    unsigned int iWakeupTimeout; //Set by CTL_CMD_SET_WAKEUP_TIMEOUT
+    unsigned int arrUnreadFrames[DATA_CHANNEL_MAX_COUNT]; //Frames of each channel published but not read yet by this open file
+    unsigned int iWakeupAlign; //Set by CTL_CMD_SET_WAKEUP_ALIGN
+    unsigned int iReserved; //0
+};
+
+struct interrupt_demo_playback_stats {
+    unsigned long long lPlayedBlocks; //Blocks handed to the converter since the module is loaded
+    unsigned int iUnderruns; //The same as iUnderruns of Control Page
+    unsigned int iQueuedBlocks; //Blocks in Playback Ring, not counting the pre-filled buffer
+    unsigned int iLowWatermark; //Set by CTL_CMD_SET_PLAYBACK_WATERMARK
+    unsigned int iReserved; //0
+};
+
+#ifdef __KERNEL__
+//Everything above is shared with user applications (e.g. interrupt-demo-bench), everything below is private to the driver
 
 //Function Signatures
-static void ProcessIoControlCommand(unsigned int iIoControlCommand, unsigned long lpIoControlParameters);
+static bool IsIoControlCommandValid(unsigned int iIoControlCommand, unsigned long lpIoControlParameters);
+static long ProcessIoControlCommand(unsigned int iIoControlCommand, unsigned long lpIoControlParameters);
 
 //Sample Data
 static unsigned int arrDataDef[DATA_BUFFER_SIZE] = {350, 355, 345, 343, 354, 352, 351, 350, 350, 345, 338, 300, 245, 183, 134, 76, 20, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 45, 90, 125, 165, 200, 245, 243, 249, 245, 250, 245, 244, 245, 249, 250, 245, 225, 175, 130, 96, 50, 25, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 20, 50, 80, 124, 125, 124, 125, 125, 123, 125, 124, 124, 126, 75, 45, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 25, 49, 45, 50, 55, 52, 54, 50, 52, 51, 48, 20, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10};
 #endif
+
+#endif